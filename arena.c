@@ -0,0 +1,142 @@
+#define _DEFAULT_SOURCE
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "arena.h"
+
+////////////////////////////////////////////////////////////////////////
+
+#define MAX_SLOTS 16
+#define HUGE_PAGE (2 << 20)
+
+#define ALIGN(n, a) (((n) + (a) - 1) & ~((size_t)(a) - 1))
+
+////////////////////////////////////////////////////////////////////////
+
+struct slot
+{
+    const char *name;
+    size_t offset, size;
+};
+
+static struct slot slots[MAX_SLOTS];
+static int count;
+
+static uint8_t *base;
+static size_t length;
+static int hugetlb;
+
+////////////////////////////////////////////////////////////////////////
+
+int
+arena_reserve(const char *name, size_t size)
+{
+    size_t align;
+
+    if (base)
+        errx(EXIT_FAILURE, "arena: %s reserved after mapping", name);
+
+    if (count == MAX_SLOTS)
+        errx(EXIT_FAILURE, "arena: too many slots");
+
+    align = size >= HUGE_PAGE ? HUGE_PAGE : (size_t)sysconf(_SC_PAGESIZE);
+
+    slots[count].name = name;
+    slots[count].offset = ALIGN(length, align);
+    slots[count].size = size;
+
+    length = slots[count].offset + size;
+
+    return count++;
+}
+
+#ifdef MADV_HUGEPAGE
+static void
+advise()
+{
+    int i;
+
+    for (i = 0; i < count; ++i)
+        if (slots[i].size >= HUGE_PAGE)
+            madvise(base + slots[i].offset, ALIGN(slots[i].size, HUGE_PAGE), MADV_HUGEPAGE);
+}
+#else
+static void
+advise()
+{
+}
+#endif
+
+void
+arena_map(int huge)
+{
+    length = ALIGN(length, HUGE_PAGE);
+    base = MAP_FAILED;
+    hugetlb = 0;
+
+#ifdef MAP_HUGETLB
+    if (huge)
+    {
+        base = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        hugetlb = base != MAP_FAILED;
+    }
+#endif
+
+    if (base == MAP_FAILED)
+        base = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (base == MAP_FAILED)
+        err(EXIT_FAILURE, "arena: mmap %zu bytes", length);
+
+    if (huge && !hugetlb)
+        advise();
+}
+
+void
+arena_unmap()
+{
+    if (base)
+        munmap(base, length);
+
+    base = NULL;
+    length = 0;
+    count = 0;
+}
+
+void *
+arena_slot(int slot)
+{
+    return base + slots[slot].offset;
+}
+
+void
+arena_release(int slot)
+{
+    size_t page;
+
+    page = hugetlb ? HUGE_PAGE : (size_t)sysconf(_SC_PAGESIZE);
+
+    if (slots[slot].offset % page)
+        return;
+
+    madvise(base + slots[slot].offset, slots[slot].size & ~(page - 1), MADV_DONTNEED);
+}
+
+void
+arena_report()
+{
+    int i;
+
+    fprintf(stderr, "arena: %.1f MiB at %p, %s pages\n", length / 1048576.0, (void *)base,
+            hugetlb ? "huge" : "normal");
+
+    for (i = 0; i < count; ++i)
+        fprintf(stderr, "%9zu %9zu  %s\n", slots[i].offset, slots[i].size, slots[i].name);
+}
@@ -0,0 +1,6 @@
+int arena_reserve(const char *name, size_t size);
+void arena_map(int huge);
+void arena_unmap();
+void *arena_slot(int slot);
+void arena_release(int slot);
+void arena_report();
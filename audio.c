@@ -1,7 +1,10 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include <err.h>
 #include <stdlib.h>
 #include <sys/mman.h>
 #include <sys/types.h>
+#include <time.h>
 
 #include <alsa/asoundlib.h>
 
@@ -11,21 +14,39 @@
 #include <pthread.h>
 
 #include "audio.h"
+#include "trace.h"
 
 #define UNUSED(x) (void)(x)
 
-#define TIME_SLICE 16384
+#define RING_SIZE (1 << 20)
+#define PREFILL (RING_SIZE / 8)
+
+static char ring[RING_SIZE];
+static size_t head = 0;
+static size_t tail = 0;
+static int eof = 0;
 
-static char *buf;
-static size_t size;
+static OggVorbis_File vf;
+static size_t remaining = 0;
+static double origin = 0;
 
 static unsigned buffer_time = 8192;
+static unsigned period_time = 4096;
 static unsigned rate = 44100;
 
 static snd_pcm_t* playback_handle = 0;
 static snd_pcm_hw_params_t* hw_params = 0;
+static snd_pcm_sw_params_t* sw_params = 0;
+static snd_pcm_uframes_t buffer_size = 0;
+static snd_pcm_uframes_t period_size = 0;
 static snd_pcm_sframes_t delay = 0;
 static snd_pcm_sframes_t written = 0;
+static unsigned underruns = 0;
+
+static pthread_mutex_t stamp_lock = PTHREAD_MUTEX_INITIALIZER;
+static double stamp_pos = 0;
+static double stamp_when = 0;
+static unsigned stamp_seq = 0;
 
 void
 alsa_init()
@@ -47,7 +68,7 @@ alsa_init()
     if((err = snd_pcm_hw_params_any(playback_handle, hw_params)) < 0)
         errx(1, "Cannot initialize hardware parameter structure: %s", snd_strerror(err));
 
-    if((err = snd_pcm_hw_params_set_access(playback_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0)
+    if((err = snd_pcm_hw_params_set_access(playback_handle, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED)) < 0)
         errx(1, "Cannot set access type: %s", snd_strerror(err));
 
     if((err = snd_pcm_hw_params_set_format(playback_handle, hw_params, SND_PCM_FORMAT_S16_LE)) < 0)
@@ -62,36 +83,125 @@ alsa_init()
     if((err = snd_pcm_hw_params_set_buffer_time_near(playback_handle, hw_params, &buffer_time, 0)) < 0)
         errx(1, "Cannot set buffer time: %s", snd_strerror(err));
 
+    if((err = snd_pcm_hw_params_set_period_time_near(playback_handle, hw_params, &period_time, 0)) < 0)
+        errx(1, "Cannot set period time: %s", snd_strerror(err));
+
     if((err = snd_pcm_hw_params(playback_handle, hw_params)) < 0)
         errx(1, "Cannot set parameters: %s", snd_strerror(err));
 
+    snd_pcm_hw_params_get_buffer_size(hw_params, &buffer_size);
+    snd_pcm_hw_params_get_period_size(hw_params, &period_size, 0);
+
     snd_pcm_hw_params_free(hw_params);
 
+    if((err = snd_pcm_sw_params_malloc(&sw_params)) < 0)
+        errx(1, "Cannot allocate software parameter structure: %s", snd_strerror(err));
+
+    if((err = snd_pcm_sw_params_current(playback_handle, sw_params)) < 0)
+        errx(1, "Cannot initialize software parameter structure: %s", snd_strerror(err));
+
+    if((err = snd_pcm_sw_params_set_avail_min(playback_handle, sw_params, period_size)) < 0)
+        errx(1, "Cannot set minimum available count: %s", snd_strerror(err));
+
+    if((err = snd_pcm_sw_params_set_start_threshold(playback_handle, sw_params, buffer_size)) < 0)
+        errx(1, "Cannot set start threshold: %s", snd_strerror(err));
+
+    if((err = snd_pcm_sw_params_set_tstamp_mode(playback_handle, sw_params, SND_PCM_TSTAMP_ENABLE)) < 0)
+        errx(1, "Cannot enable timestamps: %s", snd_strerror(err));
+
+    if((err = snd_pcm_sw_params_set_tstamp_type(playback_handle, sw_params, SND_PCM_TSTAMP_TYPE_MONOTONIC)) < 0)
+        errx(1, "Cannot set timestamp type: %s", snd_strerror(err));
+
+    if((err = snd_pcm_sw_params(playback_handle, sw_params)) < 0)
+        errx(1, "Cannot set software parameters: %s", snd_strerror(err));
+
+    snd_pcm_sw_params_free(sw_params);
+
     if((err = snd_pcm_prepare(playback_handle)) < 0)
         errx(1, "Cannot prepare audio interface for use: %s", snd_strerror(err));
 }
 
-size_t
+double
 alsa_offset()
 {
     snd_pcm_delay(playback_handle, &delay);
 
-    return written - delay;
+    return origin + (double)(written - delay) / rate;
 }
 
-static size_t
-alsa_write(const void *samples, size_t numbytes)
+unsigned
+alsa_position(double *pos, double *when)
 {
-    int ret;
+    unsigned seq;
+
+    pthread_mutex_lock(&stamp_lock);
+    *pos = stamp_pos;
+    *when = stamp_when;
+    seq = stamp_seq;
+    pthread_mutex_unlock(&stamp_lock);
+
+    return seq;
+}
+
+static void
+alsa_timestamp()
+{
+    snd_pcm_uframes_t avail;
+    snd_htimestamp_t ts;
+
+    if (snd_pcm_state(playback_handle) != SND_PCM_STATE_RUNNING)
+        return;
+
+    if (snd_pcm_htimestamp(playback_handle, &avail, &ts) < 0)
+        return;
+
+    pthread_mutex_lock(&stamp_lock);
+    stamp_pos = origin + (double)(written - (snd_pcm_sframes_t)(buffer_size - avail)) / rate;
+    stamp_when = ts.tv_sec + ts.tv_nsec * 1e-9;
+    ++stamp_seq;
+    pthread_mutex_unlock(&stamp_lock);
+}
+
+unsigned
+alsa_underruns()
+{
+    return __atomic_load_n(&underruns, __ATOMIC_RELAXED);
+}
+
+static void
+alsa_recover(int ret)
+{
+    if (ret == -EPIPE)
+    {
+        trace_instant("underrun");
+        fprintf(stderr, "audio underrun (%u)\n", __atomic_add_fetch(&underruns, 1, __ATOMIC_RELAXED));
+    }
+
+    if((ret = snd_pcm_recover(playback_handle, ret, 1)) < 0)
+        errx(EXIT_FAILURE, "ALSA playback failed: %s", snd_strerror(ret));
+}
 
-    ret = snd_pcm_writei(playback_handle, samples, numbytes);
+static snd_pcm_sframes_t
+alsa_write(const char *samples, snd_pcm_uframes_t frames)
+{
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset;
+    snd_pcm_sframes_t ret;
+    char *dst;
 
-    if(ret == -EAGAIN)
+    if((ret = snd_pcm_mmap_begin(playback_handle, &areas, &offset, &frames)) < 0) {
+        alsa_recover(ret);
         return 0;
+    }
+
+    dst = (char *)areas[0].addr + areas[0].first / 8 + offset * areas[0].step / 8;
+    memcpy(dst, samples, frames * 4);
+
+    ret = snd_pcm_mmap_commit(playback_handle, offset, frames);
 
     if(ret < 0) {
-        if((ret = snd_pcm_recover(playback_handle, ret, 0)) < 0)
-            errx(EXIT_FAILURE, "ALSA playback failed: %s", strerror(-ret));
+        alsa_recover(ret);
+        return 0;
     }
 
     written += ret;
@@ -100,77 +210,244 @@ alsa_write(const void *samples, size_t numbytes)
 }
 
 #define MIN(a,b) ((a)>(b)?(b):(a))
+
+static void
+snooze(long ns)
+{
+    struct timespec ts;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = ns;
+
+    nanosleep(&ts, NULL);
+}
+
+static size_t
+ring_readable(const char **p)
+{
+    size_t h, t;
+
+    h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    t = tail;
+
+    *p = ring + t % RING_SIZE;
+
+    return MIN(h - t, RING_SIZE - t % RING_SIZE);
+}
+
+static size_t
+ring_writable(char **p)
+{
+    size_t h, t;
+
+    h = head;
+    t = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+
+    *p = ring + h % RING_SIZE;
+
+    return MIN(RING_SIZE - (h - t), RING_SIZE - h % RING_SIZE);
+}
+
 static void *
 play_thread(void *arg)
 {
+    snd_pcm_sframes_t avail, fill;
+    const char *p;
+    double begin;
+    size_t n;
+    int ret;
+
+    UNUSED(arg);
+
+    trace_thread("audio");
+
+    for (;;)
+    {
+        if ((avail = snd_pcm_avail_update(playback_handle)) < 0)
+        {
+            alsa_recover(avail);
+            continue;
+        }
+
+        alsa_timestamp();
+
+        if ((snd_pcm_uframes_t)avail < period_size)
+        {
+            begin = trace_begin();
+
+            if((ret = snd_pcm_wait(playback_handle, 1000)) < 0)
+                alsa_recover(ret);
+
+            trace_end("wait", begin);
+            continue;
+        }
+
+        if (!(n = ring_readable(&p) / 4))
+        {
+            if (__atomic_load_n(&eof, __ATOMIC_ACQUIRE) && !ring_readable(&p))
+                break;
+
+            snooze(1000000);
+            continue;
+        }
+
+        begin = trace_begin();
+        fill = alsa_write(p, MIN(n, (size_t)avail));
+        trace_end("write", begin);
+        __atomic_store_n(&tail, tail + fill * 4, __ATOMIC_RELEASE);
+    }
+
+    if (snd_pcm_state(playback_handle) == SND_PCM_STATE_PREPARED)
+        snd_pcm_start(playback_handle);
+
+    return NULL;
+}
+
+static void *
+decode_thread(void *arg)
+{
+    int ret, section;
+    double begin;
+    size_t n;
     char *p;
-    size_t fill, n;
 
     UNUSED(arg);
 
-    p = buf;
-    n = size;
+    trace_thread("decoder");
 
-    for (;n;)
+    for (;;)
     {
-        fill = alsa_write(p, n % TIME_SLICE);
-        p += fill * 4;
-        n -= fill * 4;
+        if (!remaining)
+            break;
 
-        if (alsa_offset() > 105 * 4 * 44100)
+        if (!(n = ring_writable(&p)))
+        {
+            snooze(10000000);
+            continue;
+        }
+
+        begin = trace_begin();
+        ret = ov_read(&vf, p, MIN(MIN(n, remaining), 4096), 0, 2, 1, &section);
+        trace_end("decode", begin);
+
+        if (ret == 0) {
             break;
+        } else if (ret < 0) {
+            fprintf(stderr, "decode error\n");
+            continue;
+        }
+
+        remaining -= ret;
+
+        __atomic_store_n(&head, head + ret, __ATOMIC_RELEASE);
     }
 
+    ov_clear(&vf);
+
+    __atomic_store_n(&eof, 1, __ATOMIC_RELEASE);
+
     return NULL;
 }
 
-static char *
-oggvorbis_decode(const char *path)
+static void
+oggvorbis_open(const char *path, double from, double to)
 {
-    int ret, section;
+    ogg_int64_t first, last;
+    int ret;
+    long hz;
     FILE *f;
-    char *p;
-    OggVorbis_File vf;
 
     if (NULL == (f = fopen(path, "r")))
         err(EXIT_FAILURE, "fopen");
 
-    if(0 > (ret = ov_open_callbacks(f, &vf, NULL, 0, OV_CALLBACKS_NOCLOSE)))
+    if(0 > (ret = ov_open_callbacks(f, &vf, NULL, 0, OV_CALLBACKS_DEFAULT)))
         errx(EXIT_FAILURE, "ov_open_callbacks: %d", ret);
 
-    size = 4 * ov_pcm_total(&vf, -1);
+    hz = ov_info(&vf, -1)->rate;
+    last = ov_pcm_total(&vf, -1);
+
+    first = from > 0 ? from * hz : 0;
+    first = MIN(first, last);
+
+    if (to * hz < last)
+        last = to * hz;
+
+    if(first && 0 > (ret = ov_pcm_seek(&vf, first)))
+        errx(EXIT_FAILURE, "ov_pcm_seek: %d", ret);
+
+    origin = (double)first / hz;
+    remaining = last > first ? 4 * (last - first) : 0;
+}
+
+float *
+oggvorbis_decode(const char *path, long *rate, size_t *n)
+{
+    OggVorbis_File file;
+    int c, channels, ret, section;
+    float **planes, *pcm;
+    ogg_int64_t total;
+    long i, got;
+    FILE *f;
+
+    if (NULL == (f = fopen(path, "r")))
+        err(EXIT_FAILURE, "%s", path);
+
+    if(0 > (ret = ov_open_callbacks(f, &file, NULL, 0, OV_CALLBACKS_DEFAULT)))
+        errx(EXIT_FAILURE, "ov_open_callbacks: %d", ret);
 
-    if (NULL == (buf = malloc(size + 16 * 4 * 44100)))
-        err(EXIT_FAILURE, "malloc buf");
+    *rate = ov_info(&file, -1)->rate;
+    channels = ov_info(&file, -1)->channels;
+    total = ov_pcm_total(&file, -1);
 
-    memset(buf, '\0', size + 16 * 4 * 44100);
+    if (total <= 0 || NULL == (pcm = malloc(total * sizeof(*pcm))))
+        errx(EXIT_FAILURE, "malloc pcm");
 
-    for (p = buf;;p += ret)
+    for (*n = 0; *n < (size_t)total; *n += got)
     {
-        ret = ov_read(&vf, p, 4096, 0, 2, 1, &section);
+        if (0 == (got = ov_read_float(&file, &planes, 4096, &section)))
+            break;
 
-        if (ret == 0) {
+        if (got < 0)
+        {
+            fprintf(stderr, "%s: decode error %ld, using the first %zu samples\n", path, got, *n);
             break;
-        } else if (ret < 0) {
-            fprintf(stderr, "decode error\n");
+        }
+
+        got = MIN(got, (long)(total - *n));
+
+        for (i = 0; i < got; ++i)
+        {
+            for (pcm[*n + i] = 0, c = 0; c < channels; ++c)
+                pcm[*n + i] += planes[c][i];
+
+            pcm[*n + i] /= channels;
         }
     }
 
-    ov_clear(&vf);
+    ov_clear(&file);
 
-    return buf;
+    return pcm;
 }
 
 void
-alsa_play(const char *path)
+alsa_open(const char *path, double from, double to)
 {
-    pthread_attr_t attr;
-    pthread_t audio;
+    pthread_t decoder;
+
+    oggvorbis_open(path, from, to);
+
+    if(pthread_create(&decoder, NULL, decode_thread, NULL))
+        err(EXIT_FAILURE, "pthread_create");
 
-    oggvorbis_decode(path);
+    while (__atomic_load_n(&head, __ATOMIC_ACQUIRE) < PREFILL && !__atomic_load_n(&eof, __ATOMIC_ACQUIRE))
+        snooze(1000000);
+}
 
-    pthread_attr_init(&attr);
+void
+alsa_play()
+{
+    pthread_t audio;
 
-    if(pthread_create(&audio, &attr, play_thread, NULL))
+    if(pthread_create(&audio, NULL, play_thread, NULL))
         err(EXIT_FAILURE, "pthread_create");
 }
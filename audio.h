@@ -1,8 +1,8 @@
-struct song {
-    char *buf;
-    size_t len;
-};
+float *oggvorbis_decode(const char *path, long *rate, size_t *n);
 
 void alsa_init();
-void alsa_play(const char *path);
-size_t alsa_offset();
+void alsa_open(const char *path, double from, double to);
+void alsa_play();
+double alsa_offset();
+unsigned alsa_position(double *pos, double *when);
+unsigned alsa_underruns();
@@ -0,0 +1,481 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "effects.h"
+#include "kernels.h"
+#include "pool.h"
+#include "timeline.h"
+
+////////////////////////////////////////////////////////////////////////
+
+#define LENGTH(a) (sizeof(a) / sizeof((a)[0]))
+#define MAX(a,b) ((a)<(b)?(b):(a))
+
+#define WARMUP 5
+#define PERIOD (1.0 / 60)
+#define REBUILD_ERR 16
+#define MAX_SCENES 32
+
+////////////////////////////////////////////////////////////////////////
+
+struct bench
+{
+    const char *name;
+    float t;
+};
+
+struct scene
+{
+    float start, end;
+    int frames;
+    double ms;
+};
+
+static const struct bench benches[] = {
+    { "mandelbrot", -1 },
+    { "mandelbrot",  8 },
+    { "mandelbrot", 16 },
+    { "koch",       23 },
+    { "kochz",      35 },
+    { "kochz",      50 },
+    { "qochz",      60 },
+    { "qoch",       71 },
+    { "fire",       85 },
+};
+
+static const char *presets[] = {
+    "640x360", "640x480", "800x600", "1024x768", "1280x720",
+    "1280x1024", "1600x1200", "1920x1080", "1920x1200",
+};
+
+////////////////////////////////////////////////////////////////////////
+
+static double
+now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int
+compare(const void *a, const void *b)
+{
+    double x, y;
+
+    x = *(const double *)a;
+    y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double
+percentile(const double *sorted, int n, int p)
+{
+    return sorted[(n - 1) * p / 100];
+}
+
+static int
+draw(float t, struct frame *f, uint8_t *mask)
+{
+    f->parity = -1;
+
+    if (timeline_render(t, f, 1))
+        return bw * bh;
+
+    memset(mask, 0, sh * sh);
+
+    if (timeline_trace(t, mask, sh))
+        return sh * sh;
+
+    return 0;
+}
+
+static void
+run(const struct bench *b, int frames, struct frame *f, uint8_t *mask, double *ms)
+{
+    double begin, sum;
+    int i, pixels;
+
+    timeline_prepare(b->t);
+    timeline_warm_up(b->t);
+
+    pixels = 0;
+
+    for (i = -WARMUP; i < frames; ++i)
+    {
+        begin = now();
+
+        if (!(pixels = draw(b->t, f, mask)))
+            errx(EXIT_FAILURE, "%s: nothing rendered at %g", b->name, b->t);
+
+        if (i >= 0)
+            ms[i] = (now() - begin) * 1e3;
+    }
+
+    for (sum = 0, i = 0; i < frames; ++i)
+        sum += ms[i];
+
+    qsort(ms, frames, sizeof(*ms), compare);
+
+    printf("%s,%d,%d,%g,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f\n",
+           b->name, sw, sh, b->t, frames, sum / frames,
+           percentile(ms, frames, 50), percentile(ms, frames, 95),
+           percentile(ms, frames, 99), ms[frames - 1],
+           pixels * frames / sum / 1e3);
+}
+
+static uint64_t
+hash(const uint8_t *p, size_t n)
+{
+    uint64_t h;
+
+    for (h = 0xcbf29ce484222325; n--; ++p)
+        h = (h ^ *p) * 0x100000001b3;
+
+    return h;
+}
+
+static size_t
+capture(const struct bench *b, const struct kernels *k, int parity, struct frame *f, uint8_t *mask, uint8_t *out)
+{
+    kernels = k;
+
+    timeline_prepare(1e9);
+    timeline_prepare(b->t);
+    timeline_warm_up(b->t);
+
+    memset(f->pixels, 0, bw * bh * 3);
+
+    if (parity < 0)
+    {
+        if (draw(b->t, f, mask) != bw * bh)
+            return 0;
+    }
+    else
+    {
+        f->parity = 0;
+
+        if (!timeline_render(b->t, f, 1) || f->parity < 0)
+            return 0;
+
+        f->parity = 1;
+        timeline_render(b->t, f, 1);
+    }
+
+    memcpy(out, f->pixels, bw * bh * 3);
+
+    return bw * bh * 3;
+}
+
+static size_t
+rebuild(const struct bench *b, struct frame *f, struct frame *prev, uint8_t *out)
+{
+    kernels = &reference_kernels;
+
+    timeline_prepare(1e9);
+    timeline_prepare(b->t - PERIOD);
+    timeline_warm_up(b->t - PERIOD);
+
+    prev->parity = -1;
+
+    if (!timeline_render(b->t - PERIOD, prev, 1))
+        return 0;
+
+    timeline_prepare(b->t);
+    timeline_wait(b->t);
+
+    memset(f->pixels, 0, bw * bh * 3);
+    f->parity = 0;
+
+    if (!timeline_render(b->t, f, 1) || f->parity < 0)
+        return 0;
+
+    reconstruct(f, prev);
+    memcpy(out, f->pixels, bw * bh * 3);
+
+    return bw * bh * 3;
+}
+
+static int
+report(const struct bench *b, const char *mode, const char *name, const uint8_t *ref, const uint8_t *opt, size_t n,
+       int limit, double mean)
+{
+    int e, max;
+    double sum;
+    size_t i;
+
+    for (max = 0, sum = 0, i = 0; i < n; ++i)
+    {
+        e = abs(ref[i] - opt[i]);
+        sum += e;
+
+        if (max < e)
+            max = e;
+    }
+
+    printf("%s,%d,%d,%g,%s,%s,%d,%.6f,%016llx,%016llx\n",
+           b->name, sw, sh, b->t, mode, name, max, sum / n,
+           (unsigned long long)hash(ref, n), (unsigned long long)hash(opt, n));
+
+    return max > limit || sum / n > mean;
+}
+
+static int
+diff(const struct bench *b, struct frame *f, struct frame *prev, uint8_t *mask, uint8_t *ref, uint8_t *opt, int limit)
+{
+    const struct kernels *const *k;
+    int failed;
+    size_t n;
+
+    if (!(n = capture(b, &reference_kernels, -1, f, mask, ref)))
+        return 0;
+
+    for (failed = 0, k = kernel_variants; *k; ++k)
+    {
+        if (*k == &reference_kernels || !(*k)->supported())
+            continue;
+
+        capture(b, *k, -1, f, mask, opt);
+        failed |= report(b, "full", (*k)->name, ref, opt, n, limit, 255);
+    }
+
+    memcpy(f->pixels, ref, n);
+    reference_kernels.bgr(ref, f->pixels, n / 3);
+
+    for (k = kernel_variants; *k; ++k)
+    {
+        if (*k == &reference_kernels || !(*k)->supported())
+            continue;
+
+        (*k)->bgr(opt, f->pixels, n / 3);
+        failed |= report(b, "bgr", (*k)->name, ref, opt, n, limit, 255);
+    }
+
+    if (!capture(b, &reference_kernels, 0, f, mask, ref))
+        return failed;
+
+    for (k = kernel_variants; *k; ++k)
+    {
+        if (*k == &reference_kernels || !(*k)->supported())
+            continue;
+
+        capture(b, *k, 0, f, mask, opt);
+        failed |= report(b, "checkerboard", (*k)->name, ref, opt, n, limit, 255);
+    }
+
+    if (!rebuild(b, f, prev, opt))
+        return failed;
+
+    capture(b, &reference_kernels, -1, f, mask, ref);
+    failed |= report(b, "reconstruct", reference_kernels.name, ref, opt, n, 255, REBUILD_ERR);
+
+    return failed;
+}
+
+static void
+replay(FILE *file, struct frame *f, uint8_t *mask)
+{
+    struct scene scenes[MAX_SCENES];
+    double begin, load, total;
+    float t, start, end;
+    int frames, i;
+
+    memset(scenes, 0, sizeof(scenes));
+    load = 0;
+    frames = 0;
+
+    rewind(file);
+
+    if (fscanf(file, "%*d %*d") < 0)
+        errx(EXIT_FAILURE, "empty timestamp file");
+
+    while (1 == fscanf(file, "%f %*f", &t))
+    {
+        begin = now();
+        timeline_prepare(t);
+        load += now() - begin;
+
+        if (0 > (i = timeline_scene(t, &start, &end)) || i >= MAX_SCENES)
+            continue;
+
+        scenes[i].start = start;
+        scenes[i].end = end;
+
+        begin = now();
+        draw(t, f, mask);
+        scenes[i].ms += now() - begin;
+        ++scenes[i].frames;
+
+        ++frames;
+    }
+
+    printf("scene,start,end,width,height,frames,total_ms,mean_ms\n");
+
+    for (total = 0, i = 0; i < MAX_SCENES; ++i)
+    {
+        if (!scenes[i].frames)
+            continue;
+
+        printf("%d,%g,%g,%d,%d,%d,%.3f,%.3f\n",
+               i, scenes[i].start, scenes[i].end, sw, sh, scenes[i].frames,
+               scenes[i].ms * 1e3, scenes[i].ms * 1e3 / scenes[i].frames);
+
+        total += scenes[i].ms;
+    }
+
+    printf("load,,,%d,%d,,%.3f,\n", sw, sh, load * 1e3);
+    printf("total,,,%d,%d,%d,%.3f,%.3f\n", sw, sh, frames,
+           (total + load) * 1e3, frames ? (total + load) * 1e3 / frames : 0);
+}
+
+static int
+resolution(const char *size, int frames, double *ms, FILE *timestamps, int limit)
+{
+    uint8_t *mask, *ref, *opt;
+    struct frame *f, *prev;
+    void *p;
+    int failed, w, h;
+    size_t i;
+
+    if (2 != sscanf(size, "%dx%d", &w, &h) || w <= 0 || h <= 0)
+        errx(EXIT_FAILURE, "bad resolution: %s", size);
+
+    effects_size(w, h);
+
+    effects_reserve(1);
+    arena_map(getenv("EUCLID_HUGEPAGES") && atoi(getenv("EUCLID_HUGEPAGES")));
+
+    if (getenv("EUCLID_ARENA") && atoi(getenv("EUCLID_ARENA")))
+        arena_report();
+
+    if (posix_memalign(&p, 64, sizeof(struct frame) + bh * bw * 3))
+        errx(EXIT_FAILURE, "posix_memalign frame");
+
+    f = p;
+
+    if (posix_memalign(&p, 64, sizeof(struct frame) + bh * bw * 3))
+        errx(EXIT_FAILURE, "posix_memalign previous frame");
+
+    prev = p;
+
+    if (NULL == (mask = malloc(sh * sh)))
+        errx(EXIT_FAILURE, "malloc mask");
+
+    if (NULL == (ref = malloc(MAX(bw * bh * 3, sh * sh))))
+        errx(EXIT_FAILURE, "malloc reference");
+
+    if (NULL == (opt = malloc(MAX(bw * bh * 3, sh * sh))))
+        errx(EXIT_FAILURE, "malloc output");
+
+    failed = 0;
+
+    if (limit >= 0)
+    {
+        for (i = 0; i < LENGTH(benches); ++i)
+            failed |= diff(benches + i, f, prev, mask, ref, opt, limit);
+
+        kernels_init();
+    }
+    else if (timestamps)
+        replay(timestamps, f, mask);
+    else
+        for (i = 0; i < LENGTH(benches); ++i)
+            run(benches + i, frames, f, mask, ms);
+
+    timeline_prepare(1e9);
+    arena_unmap();
+
+    free(opt);
+    free(ref);
+    free(mask);
+    free(prev);
+    free(f);
+
+    return failed;
+}
+
+int
+main(int argc, char *argv[])
+{
+    FILE *timestamps;
+    char size[32];
+    double *ms;
+    size_t i;
+    int c, failed, frames, limit, w, h;
+
+    frames = 60;
+    limit = -1;
+    timestamps = NULL;
+
+    while (-1 != (c = getopt(argc, argv, "de:n:r:")))
+    {
+        switch (c)
+        {
+        case 'd':
+            limit = MAX(limit, 0);
+            break;
+        case 'e':
+            limit = atoi(optarg);
+            break;
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        case 'r':
+            if (NULL == (timestamps = fopen(optarg, "r")))
+                err(EXIT_FAILURE, "%s", optarg);
+            break;
+        default:
+            errx(EXIT_FAILURE, "usage: %s [-d] [-e MAXERR] [-n FRAMES] [-r TIMESTAMPS] [WIDTHxHEIGHT ...]", argv[0]);
+        }
+    }
+
+    if (frames < 1)
+        errx(EXIT_FAILURE, "need at least one frame");
+
+    if (NULL == (ms = malloc(frames * sizeof(*ms))))
+        errx(EXIT_FAILURE, "malloc times");
+
+    kernels_init();
+    pool_init(0);
+
+    failed = 0;
+
+    if (limit >= 0)
+        printf("effect,width,height,t,mode,kernels,max_err,mean_err,reference_hash,hash\n");
+    else if (!timestamps)
+        printf("effect,width,height,t,frames,mean_ms,p50_ms,p95_ms,p99_ms,max_ms,mpix_s\n");
+
+    if (optind < argc)
+    {
+        for (; optind < argc; ++optind)
+            failed |= resolution(argv[optind], frames, ms, timestamps, limit);
+    }
+    else if (timestamps && limit < 0)
+    {
+        if (2 != fscanf(timestamps, "%d %d", &w, &h))
+            errx(EXIT_FAILURE, "bad timestamp file");
+
+        snprintf(size, sizeof(size), "%dx%d", w, h);
+        resolution(size, frames, ms, timestamps, limit);
+    }
+    else
+    {
+        for (i = 0; i < LENGTH(presets); ++i)
+            failed |= resolution(presets[i], frames, ms, NULL, limit);
+    }
+
+    free(ms);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,274 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#include "cache.h"
+
+////////////////////////////////////////////////////////////////////////
+
+#define ALIGN 64
+#define MAX_ENTRIES 32
+
+#define PAD(n) (((n) + ALIGN - 1) & ~(size_t)(ALIGN - 1))
+
+struct header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t width, height, size;
+    char reserved[ALIGN - 24];
+};
+
+struct record
+{
+    char name[48];
+    uint64_t size;
+    char reserved[ALIGN - 56];
+};
+
+struct entry
+{
+    char name[48];
+    const void *data;
+    size_t size;
+};
+
+////////////////////////////////////////////////////////////////////////
+
+static int fd = -1;
+
+static uint8_t *map = NULL;
+static size_t mapped = 0;
+static size_t length = 0;
+
+static struct entry entries[MAX_ENTRIES];
+static int numentries = 0;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+////////////////////////////////////////////////////////////////////////
+
+static int
+directory(char *path, size_t n)
+{
+    const char *base;
+
+    if ((base = getenv("EUCLID_CACHE")))
+        snprintf(path, n, "%s", base);
+    else if ((base = getenv("XDG_CACHE_HOME")))
+        snprintf(path, n, "%s/euclid", base);
+    else if ((base = getenv("HOME")))
+        snprintf(path, n, "%s/.cache/euclid", base);
+    else
+        return 0;
+
+    if (!*path || !strcmp(path, "0"))
+        return 0;
+
+    if (mkdir(path, 0755) && access(path, W_OK | X_OK))
+        return 0;
+
+    return 1;
+}
+
+static struct entry *
+find(const char *name)
+{
+    int i;
+
+    for (i = 0; i < numentries; ++i)
+        if (!strcmp(entries[i].name, name))
+            return entries + i;
+
+    return NULL;
+}
+
+static void
+add(const char *name, const void *data, size_t size)
+{
+    strcpy(entries[numentries].name, name);
+    entries[numentries].data = data;
+    entries[numentries].size = size;
+    ++numentries;
+}
+
+static void
+scan(const struct header *key, const char *path)
+{
+    const struct record *r;
+
+    if (mapped < sizeof(struct header) || memcmp(map, key, sizeof(struct header)))
+        return;
+
+    length = sizeof(struct header);
+
+    while (length + sizeof(struct record) <= mapped)
+    {
+        r = (const struct record *)(map + length);
+
+        if (r->name[sizeof(r->name) - 1] || r->size > mapped - length - sizeof(struct record))
+            break;
+
+        if (find(r->name) || numentries == MAX_ENTRIES)
+        {
+            warnx("%s: %s %s, starting over", path,
+                  numentries == MAX_ENTRIES ? "too many assets at" : "duplicate", r->name);
+            numentries = 0;
+            return;
+        }
+
+        add(r->name, r + 1, r->size);
+
+        length += sizeof(struct record) + PAD(r->size);
+    }
+
+    if (length > mapped)
+        length = mapped;
+}
+
+void
+cache_open(int w, int h, int size)
+{
+    struct header key;
+    struct stat st;
+    char dir[4096], path[4200];
+
+    if (!directory(dir, sizeof(dir)))
+        return;
+
+    memset(&key, 0, sizeof(key));
+    memcpy(key.magic, "euclid", 6);
+    key.version = CACHE_VERSION;
+    key.width = w;
+    key.height = h;
+    key.size = size;
+
+    snprintf(path, sizeof(path), "%s/assets-%dx%d-%d-v%d", dir, w, h, size, CACHE_VERSION);
+
+    if (-1 == (fd = open(path, O_RDWR | O_CREAT, 0644)))
+    {
+        warn("%s", path);
+        return;
+    }
+
+    if (-1 == fstat(fd, &st))
+        err(EXIT_FAILURE, "fstat %s", path);
+
+    if (st.st_size)
+    {
+        if (MAP_FAILED == (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)))
+            err(EXIT_FAILURE, "mmap %s", path);
+
+        mapped = st.st_size;
+
+        scan(&key, path);
+    }
+
+    if (!numentries)
+    {
+        length = sizeof(struct header);
+
+        if (-1 == ftruncate(fd, 0) || -1 == pwrite(fd, &key, sizeof(key), 0))
+        {
+            warn("%s", path);
+            close(fd);
+            fd = -1;
+        }
+    }
+    else if (-1 == ftruncate(fd, length))
+    {
+        warn("%s", path);
+    }
+}
+
+void
+cache_close()
+{
+    if (map)
+        munmap(map, mapped);
+
+    if (fd != -1)
+        close(fd);
+
+    fd = -1;
+    map = NULL;
+    mapped = 0;
+    length = 0;
+    numentries = 0;
+}
+
+const void *
+cache_get(const char *name, size_t size)
+{
+    const struct entry *e;
+    const void *data;
+
+    pthread_mutex_lock(&lock);
+
+    data = (e = find(name)) && e->size == size ? e->data : NULL;
+
+    pthread_mutex_unlock(&lock);
+
+    return data;
+}
+
+void
+cache_put(const char *name, const void *data, size_t size)
+{
+    static const char zero[ALIGN];
+    struct record r;
+
+    if (strlen(name) >= sizeof(r.name))
+        return;
+
+    memset(&r, 0, sizeof(r));
+    strcpy(r.name, name);
+    r.size = size;
+
+    pthread_mutex_lock(&lock);
+
+    if (fd == -1 || find(name) || numentries == MAX_ENTRIES)
+    {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+
+    if ((ssize_t)sizeof(r) != pwrite(fd, &r, sizeof(r), length) ||
+        (ssize_t)size != pwrite(fd, data, size, length + sizeof(r)) ||
+        (ssize_t)(PAD(size) - size) != pwrite(fd, zero, PAD(size) - size, length + sizeof(r) + size))
+    {
+        warn("cache");
+        close(fd);
+        fd = -1;
+    }
+    else
+    {
+        add(name, NULL, size);
+        length += sizeof(r) + PAD(size);
+    }
+
+    pthread_mutex_unlock(&lock);
+}
+
+void
+cache_free(const void *p)
+{
+    const uint8_t *q;
+
+    q = p;
+
+    if (map && q >= map && q < map + mapped)
+        return;
+
+    free((void *)p);
+}
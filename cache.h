@@ -0,0 +1,7 @@
+#define CACHE_VERSION 3
+
+void cache_open(int w, int h, int size);
+void cache_close();
+const void *cache_get(const char *name, size_t size);
+void cache_put(const char *name, const void *data, size_t size);
+void cache_free(const void *p);
@@ -0,0 +1,207 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <errno.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "audio.h"
+#include "clock.h"
+
+#define RESYNC 0.1
+#define DETECT 60
+#define STEADY 0.05
+#define MAX_REFRESH 360
+
+static double origin = -1;
+
+static double anchor = 0;
+static double base = 0;
+static double ratio = 1;
+static double error = 0;
+static double last = 0;
+
+static unsigned seq = 0;
+
+static double interval = 0;
+static double deadline = 0;
+static double previous = 0;
+static double intervals[DETECT];
+static int measured = 0;
+static int limiting = 0;
+static int detect = 0;
+
+double
+clock_monotonic()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+follow(double pos, double when)
+{
+    double predicted;
+
+    predicted = base + (when - anchor) * ratio;
+    error = pos - predicted;
+
+    if (fabs(error) > RESYNC)
+    {
+        base = pos;
+        anchor = when;
+        return;
+    }
+
+    base = predicted + 0.05 * error;
+    anchor = when;
+
+    ratio += 0.005 * error;
+
+    if (ratio < 0.99)
+        ratio = 0.99;
+    else if (ratio > 1.01)
+        ratio = 1.01;
+}
+
+void
+clock_start(double t)
+{
+    base = t;
+    last = t;
+}
+
+double
+clock_now()
+{
+    double now, pos, when, t;
+    unsigned n;
+
+    now = clock_monotonic();
+
+    if (origin == -1)
+    {
+        origin = now;
+        anchor = now;
+    }
+
+    if ((n = alsa_position(&pos, &when)) != seq)
+    {
+        seq = n;
+        follow(pos, when);
+    }
+
+    t = base + (now - anchor) * ratio;
+
+    if (t < last)
+        t = last;
+
+    return last = t;
+}
+
+void
+clock_drift(double *ppm, double *offset)
+{
+    *ppm = (ratio - 1) * 1e6;
+    *offset = error;
+}
+
+void
+clock_sleep(double until)
+{
+    struct timespec ts;
+
+    ts.tv_sec = until;
+    ts.tv_nsec = (until - ts.tv_sec) * 1e9;
+
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+        ;
+}
+
+static int
+compare(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* with vsync, frames are shown a whole number of refresh periods apart,
+   whatever the refresh rate */
+
+static int
+vsynced()
+{
+    double sorted[DETECT], median, r;
+    int i, steady;
+
+    if (!measured)
+        return 1;
+
+    memcpy(sorted, intervals, measured * sizeof(*sorted));
+    qsort(sorted, measured, sizeof(*sorted), compare);
+
+    if ((median = sorted[measured / 2]) < 1.0 / MAX_REFRESH)
+        return 0;
+
+    for (steady = 0, i = 0; i < measured; ++i)
+    {
+        r = intervals[i] / median;
+        steady += r > .5 && fabs(r - floor(r + .5)) < STEADY;
+    }
+
+    return steady > measured * 3 / 4;
+}
+
+void
+clock_limit(double fps, int always)
+{
+    interval = fps > 0 ? 1 / fps : 0;
+    limiting = always;
+    detect = always ? 0 : DETECT;
+    previous = 0;
+    measured = 0;
+}
+
+void
+clock_pace()
+{
+    double now;
+
+    if (!interval)
+        return;
+
+    now = clock_monotonic();
+
+    if (detect)
+    {
+        if (previous)
+            intervals[measured++] = now - previous;
+
+        previous = now;
+
+        if (--detect)
+            return;
+
+        if (!(limiting = !vsynced()))
+            return;
+
+        fprintf(stderr, "no vsync, limiting to %.0f frames per second\n", 1 / interval);
+    }
+
+    if (!limiting)
+        return;
+
+    deadline += interval;
+
+    if (deadline < now - interval)
+        deadline = now;
+    else if (deadline > now)
+        clock_sleep(deadline);
+}
@@ -0,0 +1,7 @@
+double clock_monotonic();
+void clock_start(double t);
+double clock_now();
+void clock_drift(double *ppm, double *offset);
+void clock_sleep(double until);
+void clock_limit(double fps, int always);
+void clock_pace();
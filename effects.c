@@ -0,0 +1,1114 @@
+#include <err.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <GL/gl.h>
+
+#include "arena.h"
+#include "cache.h"
+#include "effects.h"
+#include "kernels.h"
+#include "lsys.h"
+#include "onset.h"
+#include "raster.h"
+
+////////////////////////////////////////////////////////////////////////
+
+#define MIN(a,b) ((a)>(b)?(b):(a))
+#define MAX(a,b) ((a)<(b)?(b):(a))
+
+////////////////////////////////////////////////////////////////////////
+
+static const struct point *koch_points[5];
+static const struct point *qoch_points[5];
+
+static float *koch_vertices;
+static float *qoch_vertices;
+
+static int koch_count;
+static int qoch_count;
+
+static uint8_t *flame;
+static uint32_t fire_step;
+
+static uint8_t mandl_palette[256][3];
+static uint8_t flame_palette[256][3];
+
+static const uint8_t *kochz;
+static const uint8_t *qochz;
+
+static float *kochz_polar;
+static float *qochz_polar;
+
+static int mandelbrot_slot, renderers;
+static int flame_slot;
+static int kochz_slot, kochz_polar_slot;
+static int qochz_slot, qochz_polar_slot;
+
+const int quality = 4;
+int bw, bh;
+int sw, sh;
+int ts;
+
+////////////////////////////////////////////////////////////////////////
+
+void
+effects_size(int w, int h)
+{
+    sw = w;
+    sh = h;
+
+    bw = sw / quality;
+    bh = sh / quality;
+
+    ts = getenv("EUCLID_TEXTURE_SIZE") ? atoi(getenv("EUCLID_TEXTURE_SIZE")) : sh;
+
+    if (bw < 1 || bh < 1)
+        errx(EXIT_FAILURE, "%dx%d: resolution too small", sw, sh);
+
+    if (ts < 4)
+        errx(EXIT_FAILURE, "texture size %d: must be at least 4", ts);
+}
+
+static size_t
+row_size()
+{
+    return (bw * (sizeof(float) + 1) + 63) & ~(size_t)63;
+}
+
+void
+effects_reserve(int threads)
+{
+    renderers = threads;
+
+    mandelbrot_slot = arena_reserve("mandelbrot", 64 * renderers + renderers * row_size());
+    flame_slot = arena_reserve("flame", bw * bh);
+    kochz_slot = arena_reserve("kochz", ts * ts * 3);
+    kochz_polar_slot = arena_reserve("kochz polar", 2 * bw * bh * sizeof(float));
+    qochz_slot = arena_reserve("qochz", ts * ts * 3);
+    qochz_polar_slot = arena_reserve("qochz polar", 2 * bw * bh * sizeof(float));
+}
+
+////////////////////////////////////////////////////////////////////////
+
+static uint32_t
+noise(uint32_t key, uint32_t x, uint32_t y)
+{
+    uint32_t h;
+
+    h = key * 0x9e3779b1 ^ x * 0x85ebca77 ^ y * 0xc2b2ae3d;
+
+    h ^= h >> 16;
+    h *= 0x7feb352d;
+    h ^= h >> 15;
+    h *= 0x846ca68b;
+    h ^= h >> 16;
+
+    return h;
+}
+
+static uint32_t
+bits(float v)
+{
+    uint32_t u;
+
+    memcpy(&u, &v, sizeof(u));
+
+    return u;
+}
+
+static void
+hsl2rgb(uint8_t rgb[3], float h, float s, float l) {
+    float v;
+    float r, g, b;
+
+    r = l;
+    g = l;
+    b = l;
+    v = (l <= 0.5) ? (l * (1.0 + s)) : (l + s - l * s);
+    if (v > 0)
+    {
+        double m;
+        double sv;
+        int sextant;
+        double fract, vsf, mid1, mid2;
+
+        m = l + l - v;
+        sv = (v - m ) / v;
+        h *= 6.0;
+        sextant = (int)h;
+        fract = h - sextant;
+        vsf = v * sv * fract;
+        mid1 = m + vsf;
+        mid2 = v - vsf;
+        switch (sextant)
+        {
+        case 0:
+            r = v;
+            g = mid1;
+            b = m;
+            break;
+        case 1:
+            r = mid2;
+            g = v;
+            b = m;
+            break;
+        case 2:
+            r = m;
+            g = v;
+            b = mid1;
+            break;
+        case 3:
+            r = m;
+            g = mid2;
+            b = v;
+            break;
+        case 4:
+            r = mid1;
+            g = m;
+            b = v;
+            break;
+        case 5:
+            r = v;
+            g = m;
+            b = mid2;
+            break;
+        }
+    }
+
+    rgb[0] = 255 * r;
+    rgb[1] = 255 * g;
+    rgb[2] = 255 * b;
+}
+
+float
+lerp(float a, float b, float t) {
+    return a + (b - a) * t;
+}
+
+float
+smoothstep(float x)
+{
+    return x * x * (3 - 2 * x);
+}
+
+void
+make_mandelbrot()
+{
+    const void *cached;
+    float h, s, l, x;
+    int i;
+
+    if ((cached = cache_get("mandelbrot palette", sizeof(mandl_palette))))
+    {
+        memcpy(mandl_palette, cached, sizeof(mandl_palette));
+        return;
+    }
+
+    for (i = 0; i < 192; ++i)
+    {
+        x = (float)i / 192;
+
+        h = fmodf(powf(2 - x, 2), .8);
+        s = 1;
+        l = 0.5 * powf(h + .1, .1);
+
+        hsl2rgb(mandl_palette[i], h, s, l);
+    }
+
+    mandl_palette[191][0] = 0;
+    mandl_palette[191][1] = 0;
+    mandl_palette[191][2] = 0;
+
+    cache_put("mandelbrot palette", mandl_palette, sizeof(mandl_palette));
+}
+
+static void
+set_view(struct view *v, int effect, float m0, float m1, float m2, float m3, float m4, float m5)
+{
+    v->effect = effect;
+    v->m[0] = m0;
+    v->m[1] = m1;
+    v->m[2] = m2;
+    v->m[3] = m3;
+    v->m[4] = m4;
+    v->m[5] = m5;
+}
+
+static int
+reproject(float c[6], const struct view *from, const struct view *to)
+{
+    const float *a, *b;
+    float det, x0, y0;
+
+    if (from->effect == EFFECT_NONE || from->effect != to->effect)
+        return 0;
+
+    a = to->m;
+    b = from->m;
+
+    det = b[1] * b[5] - b[2] * b[4];
+
+    if (fabsf(det) < 1e-12)
+        return 0;
+
+    x0 = a[0] - b[0];
+    y0 = a[3] - b[3];
+
+    c[0] = ( b[5] * x0   - b[2] * y0  ) / det;
+    c[1] = ( b[5] * a[1] - b[2] * a[4]) / det;
+    c[2] = ( b[5] * a[2] - b[2] * a[5]) / det;
+    c[3] = (-b[4] * x0   + b[1] * y0  ) / det;
+    c[4] = (-b[4] * a[1] + b[1] * a[4]) / det;
+    c[5] = (-b[4] * a[2] + b[1] * a[5]) / det;
+
+    return 1;
+}
+
+void
+reconstruct(struct frame *f, const struct frame *prev)
+{
+    const uint8_t *l, *r, *u, *d, *q;
+    float c[6];
+    int i, lo, hi, ok, x, y, X = 0, Y = 0;
+    uint8_t *p;
+
+    if (f->parity < 0)
+        return;
+
+    ok = reproject(c, &prev->view, &f->view);
+
+    for (y = 0; y < bh; ++y)
+    {
+        for (x = (y + f->parity + 1) & 1; x < bw; x += 2)
+        {
+            p = f->pixels + 3 * (y * bw + x);
+
+            l = x > 0      ? p - 3 : p + 3;
+            r = x < bw - 1 ? p + 3 : p - 3;
+            d = y > 0      ? p - 3 * bw : p + 3 * bw;
+            u = y < bh - 1 ? p + 3 * bw : p - 3 * bw;
+
+            if (ok)
+            {
+                X = lrintf(c[0] + c[1] * x + c[2] * y);
+                Y = lrintf(c[3] + c[4] * x + c[5] * y);
+            }
+
+            if (ok && X >= 0 && X < bw && Y >= 0 && Y < bh)
+            {
+                q = prev->pixels + 3 * (Y * bw + X);
+
+                for (i = 0; i < 3; ++i)
+                {
+                    lo = MIN(MIN(l[i], r[i]), MIN(u[i], d[i]));
+                    hi = MAX(MAX(l[i], r[i]), MAX(u[i], d[i]));
+
+                    p[i] = q[i] < lo ? lo : q[i] > hi ? hi : q[i];
+                }
+            }
+            else
+            {
+                for (i = 0; i < 3; ++i)
+                    p[i] = (l[i] + r[i] + u[i] + d[i] + 2) / 4;
+            }
+        }
+    }
+}
+
+static int
+claim(int *busy)
+{
+    int i;
+
+    for (;;)
+        for (i = 0; i < renderers; ++i)
+            if (!__atomic_exchange_n(busy + 16 * i, 1, __ATOMIC_ACQUIRE))
+                return i;
+}
+
+void
+draw_mandelbrot(struct frame *f, float cx, float cy, float scale, float d, float t)
+{
+    uint8_t *iter, *out, *rows;
+    uint32_t key;
+    int R, G, B;
+    int i, k, x, y;
+    float *re;
+
+    out = f->pixels;
+
+    key = noise(bits(scale), bits(d), bits(t));
+
+    set_view(&f->view, EFFECT_MANDELBROT,
+             cx - bw * scale / bh, 2 * scale / bh, 0,
+             cy + scale, 0, -2 * scale / bh);
+
+    if (t > .95)
+        d = 20 * (t - .95);
+
+    d = pow(d, .5);
+
+    rows = arena_slot(mandelbrot_slot);
+    k = claim((int *)rows);
+
+    re = (float *)(rows + 64 * renderers + k * row_size());
+    iter = (uint8_t *)(re + bw);
+
+    for (x = 0; x < bw; ++x)
+        re[x] = cx + bw * scale / bh * (-1 + 2 * (float)x / bw);
+
+    for(y = 0; y < bh; ++y) {
+        kernels->escape(iter, re, cy + scale * (1 - 2 * (float)y / bh),
+                        f->parity < 0 ? 0 : (y + f->parity) & 1,
+                        f->parity < 0 ? 1 : 2, bw, scale < 2. / 100);
+
+        for (x = f->parity < 0 ? 0 : (y + f->parity) & 1; x < bw; x += f->parity < 0 ? 1 : 2)
+        {
+            i = iter[x];
+
+            if (i == 192)
+            {
+                i = noise(key, x, y) % 48;
+
+                i -= 48 * d;
+
+                if (i < 0)
+                    i = 0;
+
+                out[y * bw * 3 + x * 3 + 0] = i;
+                out[y * bw * 3 + x * 3 + 1] = i;
+                out[y * bw * 3 + x * 3 + 2] = i;
+            }
+            else
+            {
+                R = mandl_palette[i][0];
+                G = mandl_palette[i][1];
+                B = mandl_palette[i][2];
+                R -= 256 * d; if (R < 0) R = 0;
+                G -= 256 * d; if (G < 0) G = 0;
+                B -= 256 * d; if (B < 0) B = 0;
+                out[y * bw * 3 + x * 3 + 0] = R;
+                out[y * bw * 3 + x * 3 + 1] = G;
+                out[y * bw * 3 + x * 3 + 2] = B;
+            }
+        }
+    }
+
+    __atomic_store_n((int *)rows + 16 * k, 0, __ATOMIC_RELEASE);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+static int
+stage(float t)
+{
+    if (t < .25)
+        return 0;
+    else if (t < .50)
+        return 1;
+    else if (t < .75)
+        return 2;
+    else
+        return 3;
+}
+
+static void
+morph(float *restrict out, const struct point *restrict a, const struct point *restrict b, int n, float s)
+{
+    int i;
+
+    for (i = 0; i < n; ++i)
+    {
+        out[2 * i + 0] = a[i].x + (b[i].x - a[i].x) * s;
+        out[2 * i + 1] = a[i].y + (b[i].y - a[i].y) * s;
+    }
+}
+
+static void
+draw_loop(const float *vertices, int n)
+{
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glScalef((float)sh / sw, 1, 1);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, vertices);
+    glDrawArrays(GL_LINE_LOOP, 0, n);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    glPopMatrix();
+}
+
+////////////////////////////////////////////////////////////////////////
+
+static const struct lsys koch_rule = {
+    3, 4, { 1, .5, .5, 1 }, { -TAU / 6, TAU / 3, -TAU / 6 }
+};
+
+void
+make_koch()
+{
+    struct point *points;
+    char name[16];
+    int depth, i, n;
+    size_t size;
+
+    depth = lsys_depth(1.2, sh / 2.0);
+    koch_count = lsys_count(&koch_rule, depth);
+    size = koch_count * sizeof(struct point);
+
+    for (i = 0; i < 5; ++i)
+    {
+        snprintf(name, sizeof(name), "koch %d", i);
+
+        if ((koch_points[i] = cache_get(name, size)))
+            continue;
+
+        if (NULL == (points = malloc(size)))
+            errx(EXIT_FAILURE, "malloc koch");
+
+        n = (i * depth + 2) / 4;
+
+        lsys_expand(&koch_rule, points, 1.2, -.6, -.35, depth - n, n);
+
+        cache_put(name, points, size);
+        koch_points[i] = points;
+    }
+
+    if (NULL == (koch_vertices = malloc(koch_count * 2 * sizeof(float))))
+        errx(EXIT_FAILURE, "malloc koch");
+}
+
+void
+free_koch()
+{
+    int i;
+
+    for (i = 0; i < 5; ++i)
+    {
+        cache_free(koch_points[i]);
+        koch_points[i] = NULL;
+    }
+
+    free(koch_vertices);
+    koch_vertices = NULL;
+}
+
+static void
+shape_koch(float *vertices, float t)
+{
+    int k;
+
+    k = stage(t);
+
+    morph(vertices, koch_points[k], koch_points[k + 1], koch_count,
+          smoothstep((t - .25 * k) * 4));
+}
+
+void
+draw_koch(float t)
+{
+    shape_koch(koch_vertices, t);
+
+    glColor3f(1.0, 1.0, 1.0);
+    draw_loop(koch_vertices, koch_count);
+}
+
+void
+mask_koch(uint8_t *mask, int size, float t)
+{
+    shape_koch(koch_vertices, t);
+    raster_loop(mask, size, size, koch_vertices, koch_count);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+static const uint8_t kochz_palette[8][3] = {
+    {   0,   0,   0 }, {  32,  32,  32 }, { 255, 255, 255 }, { 255, 255, 255 },
+    { 255, 255, 255 }, { 255, 255, 255 }, { 255, 220, 150 }, { 255, 192, 128 },
+};
+
+static const uint8_t qochz_palette[3][3] = {
+    {   0,   0,   0 }, { 224, 224, 224 }, { 255, 255, 255 },
+};
+
+static void
+threshold(uint8_t *restrict out, const uint8_t *restrict mask, uint8_t invert)
+{
+    int n, x, k;
+
+    n = ts & ~15;
+
+    for (x = 0; x < n; x += 16)
+        for (k = x; k < x + 16; ++k)
+            out[k] = (mask[k] > 127) ^ invert;
+
+    for (x = n; x < ts; ++x)
+        out[x] = (mask[x] > 127) ^ invert;
+}
+
+static void
+checker(uint8_t *out, int n, int width)
+{
+    int x;
+
+    for (x = 0; x < ts; ++x)
+    {
+        out[x] = (x / (ts >> 2)) & 1;
+        out[n + x] = out[x] ^ 1;
+    }
+
+    memset(out + ts, 0, width - ts);
+    memset(out + n + ts, 0, width - ts);
+}
+
+static void
+dilate(uint8_t *restrict idx, uint8_t *restrict d, const uint8_t *restrict a,
+       const uint8_t *restrict b, const uint8_t *restrict c, int width)
+{
+    int x, k;
+
+    for (x = 0; x < width; x += 16)
+        for (k = x; k < x + 16; ++k)
+            d[k] = a[k + 1] | b[k];
+
+    for (x = 0; x < width; x += 16)
+        for (k = x; k < x + 16; ++k)
+            idx[k] = MAX(MAX(MAX(3 * d[k], 4 * d[k + 1]), MAX(5 * d[k + 2], 6 * d[k + 3])),
+                         MAX(7 * d[k + 4], MAX(2 * a[k], c[k])));
+}
+
+static void
+erode(uint8_t *restrict idx, const uint8_t *restrict a, const uint8_t *restrict b,
+      const uint8_t *restrict c, int width)
+{
+    uint8_t m;
+    int x, k;
+
+    for (x = 0; x < width; x += 16)
+    {
+        for (k = x; k < x + 16; ++k)
+        {
+            m = a[k] & a[k + 1] & b[k];
+            idx[k] = m + (m & (c[k] ^ 1));
+        }
+    }
+}
+
+static void
+expand(uint8_t *out, const uint8_t *idx, const uint8_t (*palette)[3])
+{
+    int x;
+
+    for (x = 0; x < ts; ++x, out += 3)
+    {
+        out[0] = palette[idx[x]][0];
+        out[1] = palette[idx[x]][1];
+        out[2] = palette[idx[x]][2];
+    }
+}
+
+static float *
+make_polar(double phase, int slot)
+{
+    float *polar, X, Y;
+    int x, y;
+
+    polar = arena_slot(slot);
+
+    for (y = 0; y < bh; ++y)
+    {
+        for (x = 0; x < bw; ++x)
+        {
+            X = x - bw / 2;
+            Y = y - bh / 2;
+
+            polar[2 * (y * bw + x) + 0] = phase + atan2(X, Y);
+            polar[2 * (y * bw + x) + 1] = sqrtf(X * X + Y * Y);
+        }
+    }
+
+    return polar;
+}
+
+void
+make_kochz()
+{
+    float *vertices;
+    uint8_t *mask, *tex, *rows, *a, *b, *c, *d, *idx, *swap;
+    int n, width, y;
+
+    kochz_polar = make_polar(TAU / 4, kochz_polar_slot);
+
+    if ((kochz = cache_get("kochz", ts * ts * 3)))
+        return;
+
+    width = (ts + 15) & ~15;
+    n = width + 16;
+
+    tex = arena_slot(kochz_slot);
+
+    if (NULL == (mask = calloc(ts * ts, 1)))
+        errx(EXIT_FAILURE, "malloc mask");
+
+    if (NULL == (vertices = malloc(koch_count * 2 * sizeof(float))))
+        errx(EXIT_FAILURE, "malloc koch");
+
+    if (NULL == (rows = calloc(6, n)))
+        errx(EXIT_FAILURE, "malloc rows");
+
+    a = rows;
+    b = a + n;
+    c = b + n;
+    d = c + 2 * n;
+    idx = d + n;
+
+    checker(c, n, width);
+
+    shape_koch(vertices, 1);
+    raster_loop(mask, ts, ts, vertices, koch_count);
+
+    threshold(b, mask, 0);
+
+    for (y = 0; y < ts; ++y)
+    {
+        swap = a, a = b, b = swap;
+
+        if (y + 1 < ts)
+            threshold(b, mask + (y + 1) * ts, 0);
+        else
+            memset(b, 0, ts);
+
+        dilate(idx, d, a, b, c + ((y / (ts >> 2)) & 1) * n, width);
+        expand(tex + 3 * y * ts, idx, kochz_palette);
+    }
+
+    free(rows);
+    free(vertices);
+    free(mask);
+
+    cache_put("kochz", tex, ts * ts * 3);
+    kochz = tex;
+}
+
+void
+free_kochz()
+{
+    arena_release(kochz_slot);
+    kochz = NULL;
+
+    arena_release(kochz_polar_slot);
+    kochz_polar = NULL;
+}
+
+static void
+warp_view(struct view *v, int effect, float ox, float oy, float roto, float zoom)
+{
+    float cs, sn;
+
+    cs = zoom * cosf(roto);
+    sn = zoom * sinf(roto);
+
+    set_view(v, effect,
+             zoom * sh * ox + sn * (bw / 2) - cs * (bh / 2), -sn, cs,
+             zoom * sh * oy - cs * (bw / 2) - sn * (bh / 2), cs, sn);
+}
+
+void
+draw_kochz(struct frame *f, float t, float u)
+{
+    float ox, oy, roto, zoom;
+    struct warp w;
+    double beat;
+    uint8_t q;
+    int y;
+
+    if (u <= 34)
+        q = 32;
+    else if (0 <= (beat = onset_since(u)))
+        q = 64 + 32 * pow(1 - fmin(beat, 0.2) / 0.2, 4);
+    else
+        q = 64 + 32 * pow(1 - fmod(u - 0.133976, 0.472667) / 0.2, 4);
+
+    if (t < .25)
+        ox = 0, oy = 0, roto = 0, zoom = 4;
+    else if (t < .5)
+        ox = 0, oy = 0, roto = 0, zoom = 12;
+    else
+    {
+        t = 2 * (t - .5);
+        ox = lerp(0, .25, t);
+        oy = lerp(0, .25, t);
+        roto = lerp(0, 24, t);
+        zoom = lerp(12, 2, t);
+    }
+
+    zoom *= (float)ts / sh;
+
+    warp_view(&f->view, EFFECT_KOCHZ, ox, oy, TAU / 4 + roto, zoom);
+
+    w.texture = kochz;
+    w.polar = kochz_polar;
+    w.phase = TAU / 4;
+    w.roto = roto;
+    w.zoom = zoom;
+    w.ox = ox;
+    w.oy = oy;
+    w.flash = q;
+
+    for (y = 0; y < bh; ++y)
+        kernels->warp(f->pixels + y * bw * 3, y,
+                      f->parity < 0 ? 0 : (y + f->parity) & 1,
+                      f->parity < 0 ? 1 : 2, &w);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+static const struct lsys qoch_rule = {
+    4, 5, { 1, 0, 1, 0, 1 }, { -TAU / 4, TAU / 4, TAU / 4, -TAU / 4 }
+};
+
+void
+make_qoch()
+{
+    struct point *points;
+    char name[16];
+    int depth, i, n;
+    size_t size;
+
+    depth = lsys_depth(1.0, sh / 2.0);
+    qoch_count = lsys_count(&qoch_rule, depth);
+    size = qoch_count * sizeof(struct point);
+
+    for (i = 0; i < 5; ++i)
+    {
+        snprintf(name, sizeof(name), "qoch %d", i);
+
+        if ((qoch_points[i] = cache_get(name, size)))
+            continue;
+
+        if (NULL == (points = malloc(size)))
+            errx(EXIT_FAILURE, "malloc qoch");
+
+        n = (i * depth + 2) / 4;
+
+        lsys_expand(&qoch_rule, points, 1.0, -.5, -.5, depth - n, n);
+
+        cache_put(name, points, size);
+        qoch_points[i] = points;
+    }
+
+    if (NULL == (qoch_vertices = malloc(qoch_count * 2 * sizeof(float))))
+        errx(EXIT_FAILURE, "malloc qoch");
+}
+
+void
+free_qoch()
+{
+    int i;
+
+    for (i = 0; i < 5; ++i)
+    {
+        cache_free(qoch_points[i]);
+        qoch_points[i] = NULL;
+    }
+
+    free(qoch_vertices);
+    qoch_vertices = NULL;
+}
+
+static void
+shape_qoch(float *vertices, float t)
+{
+    int k;
+
+    k = stage(t);
+
+    morph(vertices, qoch_points[k], qoch_points[k + 1], qoch_count,
+          smoothstep((t - .25 * k) * 4 + 0.13 * sin(200*t)));
+}
+
+void
+draw_qoch(float t)
+{
+    shape_qoch(qoch_vertices, t);
+
+    glColor3f(0.0, 0.0, 0.0);
+    draw_loop(qoch_vertices, qoch_count);
+}
+
+void
+mask_qoch(uint8_t *mask, int size, float t)
+{
+    shape_qoch(qoch_vertices, t);
+    raster_loop(mask, size, size, qoch_vertices, qoch_count);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+void
+make_qochz()
+{
+    float *vertices;
+    uint8_t *mask, *tex, *rows, *a, *b, *c, *idx, *swap;
+    int n, width, y;
+
+    qochz_polar = make_polar(0, qochz_polar_slot);
+
+    if ((qochz = cache_get("qochz", ts * ts * 3)))
+        return;
+
+    width = (ts + 15) & ~15;
+    n = width + 16;
+
+    tex = arena_slot(qochz_slot);
+
+    if (NULL == (mask = calloc(ts * ts, 1)))
+        errx(EXIT_FAILURE, "malloc mask");
+
+    if (NULL == (vertices = malloc(qoch_count * 2 * sizeof(float))))
+        errx(EXIT_FAILURE, "malloc qoch");
+
+    if (NULL == (rows = malloc(5 * n)))
+        errx(EXIT_FAILURE, "malloc rows");
+
+    a = rows;
+    b = a + n;
+    c = b + n;
+    idx = c + 2 * n;
+
+    memset(rows, 1, 2 * n);
+    checker(c, n, width);
+
+    shape_qoch(vertices, 1);
+    raster_loop(mask, ts, ts, vertices, qoch_count);
+
+    threshold(b, mask, 1);
+
+    for (y = 0; y < ts; ++y)
+    {
+        swap = a, a = b, b = swap;
+
+        if (y + 1 < ts)
+            threshold(b, mask + (y + 1) * ts, 1);
+        else
+            memset(b, 1, ts);
+
+        erode(idx, a, b, c + ((y / (ts >> 2)) & 1) * n, width);
+        expand(tex + 3 * y * ts, idx, qochz_palette);
+    }
+
+    free(rows);
+    free(vertices);
+    free(mask);
+
+    cache_put("qochz", tex, ts * ts * 3);
+    qochz = tex;
+}
+
+void
+free_qochz()
+{
+    arena_release(qochz_slot);
+    qochz = NULL;
+
+    arena_release(qochz_polar_slot);
+    qochz_polar = NULL;
+}
+
+void
+draw_qochz(struct frame *f, float t)
+{
+    float ox, oy, roto, zoom;
+    struct warp w;
+    int y;
+
+    if (t < .25)
+        ox = 0, oy = 0, roto = 0, zoom = 4;
+    else if (t < .5)
+        ox = 0, oy = 0, roto = 0, zoom = 12;
+    else
+    {
+        t = 2 * (t - .5);
+        ox = lerp(0, .14746, t);
+        oy = lerp(0, .22265, t);
+        roto = lerp(32, 0, t);
+        zoom = lerp(12, .5, t);
+    }
+
+    zoom *= (float)ts / sh;
+
+    warp_view(&f->view, EFFECT_QOCHZ, ox, oy, roto, zoom);
+
+    w.texture = qochz;
+    w.polar = qochz_polar;
+    w.phase = 0;
+    w.roto = roto;
+    w.zoom = zoom;
+    w.ox = ox;
+    w.oy = oy;
+    w.flash = 32;
+
+    for (y = 0; y < bh; ++y)
+        kernels->warp(f->pixels + y * bw * 3, y,
+                      f->parity < 0 ? 0 : (y + f->parity) & 1,
+                      f->parity < 0 ? 1 : 2, &w);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+void
+make_fire()
+{
+    const void *cached;
+    float h, s, l, x;
+    int i;
+
+    flame = arena_slot(flame_slot);
+    restore_fire(NULL);
+
+    if ((cached = cache_get("fire palette", sizeof(flame_palette))))
+    {
+        memcpy(flame_palette, cached, sizeof(flame_palette));
+        return;
+    }
+
+    for (i = 0; i < 256; ++i)
+    {
+        x = (float)i / 256;
+
+        h = powf(x, 1.3);
+        s = 1;
+        l = powf(x, .7);
+
+        hsl2rgb(flame_palette[i], h, s, l);
+    }
+
+    cache_put("fire palette", flame_palette, sizeof(flame_palette));
+}
+
+void
+free_fire()
+{
+    arena_release(flame_slot);
+    flame = NULL;
+}
+
+int
+save_fire(uint8_t *state)
+{
+    if (state)
+    {
+        memcpy(state, &fire_step, sizeof(fire_step));
+        memcpy(state + sizeof(fire_step), flame, bw * bh);
+    }
+
+    return sizeof(fire_step) + bw * bh;
+}
+
+void
+restore_fire(const uint8_t *state)
+{
+    if (!state)
+    {
+        memset(flame, 0, bw * bh);
+        fire_step = 0;
+        return;
+    }
+
+    memcpy(&fire_step, state, sizeof(fire_step));
+    memcpy(flame, state + sizeof(fire_step), bw * bh);
+}
+
+static void
+seed(int x, int y, int ceil)
+{
+    x = x * bw / 256;
+    y = y * bh / 192;
+
+    flame[y * bw + x] = noise(fire_step, x, y * 2 + (ceil > 64)) % ceil;
+}
+
+static void
+draw_euclid(int ceil)
+{
+    int x, y;
+
+    for (x =  50; x <  70; ++x) seed(x, 140, ceil);
+    for (x =  50; x <  70; ++x) seed(x, 120, ceil);
+    for (x =  50; x <  70; ++x) seed(x, 100, ceil);
+    for (y = 100; y < 140; ++y) seed(50, y, ceil);
+
+    for (x =  80; x < 100; ++x) seed(x, 100, ceil);
+    for (y = 100; y < 140; ++y) seed(80, y, ceil);
+    for (y = 100; y < 140; ++y) seed(100, y, ceil);
+
+    for (x = 110; x < 130; ++x) seed(x, 100, ceil);
+    for (x = 110; x < 130; ++x) seed(x, 140, ceil);
+    for (y = 100; y < 140; ++y) seed(110, y, ceil);
+
+    for (x = 140; x < 160; ++x) seed(x, 100, ceil);
+    for (y = 100; y < 140; ++y) seed(140, y, ceil);
+
+    for (y = 100; y < 140; ++y) seed(170, y, ceil);
+
+    for (y = 100; y < 140; ++y)
+    {
+        seed(180, y, ceil);
+
+        if (y < 120)
+            x = 180 + (y - 100);
+        else
+            x = 220 - (y - 100);
+
+        seed(x, y, ceil);
+    }
+}
+
+void
+draw_fire(struct frame *f, float t)
+{
+    uint8_t *out;
+    int x, y;
+
+    if (t > 0 && t < 1)
+        draw_euclid(64);
+
+    for (y = bh - 1; y > 0; --y)
+        kernels->fire(flame + y * bw, flame + (y - 1) * bw, y > 1 ? flame + (y - 2) * bw : NULL, bw);
+
+    for (x = 0; x < bw; ++x)
+        flame[x] = 0;
+
+    if (t > 0 && t < 1)
+        draw_euclid(128);
+
+    if (f)
+    {
+        out = f->pixels;
+
+        f->parity = -1;
+        f->view.effect = EFFECT_NONE;
+
+        for (y = 0; y < bh; ++y)
+        {
+            for (x = 0; x < bw; ++x)
+            {
+                out[y * bw * 3 + x * 3 + 0] = flame_palette[flame[y * bw + x]][0];
+                out[y * bw * 3 + x * 3 + 1] = flame_palette[flame[y * bw + x]][1];
+                out[y * bw * 3 + x * 3 + 2] = flame_palette[flame[y * bw + x]][2];
+            }
+        }
+    }
+
+    if (t < 1)
+        for (x = 0; x < bw; ++x)
+            flame[x] = noise(fire_step, x, bh);
+
+    ++fire_step;
+}
+
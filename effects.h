@@ -0,0 +1,67 @@
+#define TAU 6.283185307179586
+
+enum
+{
+    EFFECT_NONE,
+    EFFECT_MANDELBROT,
+    EFFECT_KOCHZ,
+    EFFECT_QOCHZ,
+};
+
+struct point
+{
+    float x, y;
+};
+
+struct view
+{
+    int effect;
+    float m[6];
+};
+
+struct frame
+{
+    int parity;
+    struct view view;
+    uint8_t pixels[] __attribute__((aligned(64)));
+};
+
+extern const int quality;
+extern int bw, bh;
+extern int sw, sh;
+extern int ts;
+
+void effects_size(int w, int h);
+void effects_reserve(int threads);
+
+float lerp(float a, float b, float t);
+float smoothstep(float x);
+
+void reconstruct(struct frame *f, const struct frame *prev);
+
+void make_mandelbrot();
+void draw_mandelbrot(struct frame *f, float cx, float cy, float scale, float d, float t);
+
+void make_koch();
+void free_koch();
+void draw_koch(float t);
+void mask_koch(uint8_t *mask, int size, float t);
+
+void make_kochz();
+void free_kochz();
+void draw_kochz(struct frame *f, float t, float u);
+
+void make_qoch();
+void free_qoch();
+void draw_qoch(float t);
+void mask_qoch(uint8_t *mask, int size, float t);
+
+void make_qochz();
+void free_qochz();
+void draw_qochz(struct frame *f, float t);
+
+void make_fire();
+void free_fire();
+int save_fire(uint8_t *state);
+void restore_fire(const uint8_t *state);
+void draw_fire(struct frame *f, float t);
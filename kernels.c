@@ -0,0 +1,417 @@
+#include <err.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "effects.h"
+#include "kernels.h"
+
+////////////////////////////////////////////////////////////////////////
+
+#define LANES 16
+
+#define INLINE static inline __attribute__((always_inline))
+
+#if defined(__x86_64__) || defined(__i386__)
+#define X86 1
+#endif
+
+////////////////////////////////////////////////////////////////////////
+
+INLINE int
+inside(float a, float b, int deep)
+{
+    float dx, dy;
+
+    if (deep)
+    {
+        dx = a + 0.6506;
+        dy = b + 0.4780;
+
+        if (dx * dx + dy * dy < 0.0000007)
+            return 1;
+
+        dx = a + 0.64915;
+        dy = b + 0.47855;
+
+        return dx * dx + dy * dy < 0.0000002;
+    }
+
+    dx = a + 0.25;
+    dy = b + 0.0;
+
+    if (dx * dx + dy * dy < 0.23)
+        return 1;
+
+    dx = a + 1;
+    dy = b + 0;
+
+    if (dx * dx + dy * dy < 0.05)
+        return 1;
+
+    dx = a + 0.623;
+    dy = b + 0.425;
+
+    return dx * dx + dy * dy < 0.00035;
+}
+
+INLINE void
+escape_wide(uint8_t *iter, const float *re, float b, int from, int step, int n, int deep)
+{
+    float a[LANES], za[LANES], zb[LANES], zaa, zbb;
+    int count[LANES], live[LANES], in[LANES];
+    int any, i, k, m, x;
+
+    for (x = from; x < n; x += step * LANES)
+    {
+        m = (n - x + step - 1) / step;
+
+        for (k = 0; k < LANES; ++k)
+        {
+            a[k] = k < m ? re[x + k * step] : 0;
+            in[k] = k < m && inside(a[k], b, deep);
+            live[k] = k < m && !in[k];
+            count[k] = 0;
+            za[k] = a[k];
+            zb[k] = b;
+        }
+
+        for (i = 0; i < 192; ++i)
+        {
+            for (any = 0, k = 0; k < LANES; ++k)
+            {
+                zaa = za[k] * za[k];
+                zbb = zb[k] * zb[k];
+
+                live[k] &= !(zaa + zbb > 4);
+                count[k] += live[k];
+                any |= live[k];
+
+                zb[k] = (2 * (za[k] * zb[k])) + b;
+                za[k] = zaa - zbb + a[k];
+            }
+
+            if (!any)
+                break;
+        }
+
+        for (k = 0; k < LANES && k < m; ++k)
+            iter[x + k * step] = in[k] ? 192 : count[k];
+    }
+}
+
+INLINE void
+fire_edge(uint8_t *row, const uint8_t *above, const uint8_t *above2, int n, int x)
+{
+    double a = 0;
+
+    a += 0.60 * above[x];
+
+    if (x > 0)
+        a += 0.05 * above[x - 1];
+
+    if (x < n - 1)
+        a += 0.05 * above[x + 1];
+
+    if (above2)
+    {
+        a += 0.20 * above2[x];
+
+        if (x > 0)
+            a += 0.05 * above2[x - 1];
+
+        if (x < n - 1)
+            a += 0.05 * above2[x + 1];
+    }
+
+    row[x] = 0.99 * a;
+}
+
+INLINE void
+fire_wide(uint8_t *restrict row, const uint8_t *restrict above, const uint8_t *restrict above2, int n)
+{
+    double a;
+    int k, x;
+
+    if (n < 2)
+    {
+        for (x = 0; x < n; ++x)
+            fire_edge(row, above, above2, n, x);
+
+        return;
+    }
+
+    fire_edge(row, above, above2, n, 0);
+
+    for (x = 1; x + LANES < n; x += LANES)
+    {
+        if (above2)
+        {
+            for (k = x; k < x + LANES; ++k)
+            {
+                a = 0.60 * above[k];
+                a += 0.05 * above[k - 1];
+                a += 0.05 * above[k + 1];
+                a += 0.20 * above2[k];
+                a += 0.05 * above2[k - 1];
+                a += 0.05 * above2[k + 1];
+                row[k] = 0.99 * a;
+            }
+        }
+        else
+        {
+            for (k = x; k < x + LANES; ++k)
+            {
+                a = 0.60 * above[k];
+                a += 0.05 * above[k - 1];
+                a += 0.05 * above[k + 1];
+                row[k] = 0.99 * a;
+            }
+        }
+    }
+
+    for (; x < n; ++x)
+        fire_edge(row, above, above2, n, x);
+}
+
+/* sine and cosine of a float, computed in double precision and rounded, as
+   cosf and sinf do, but without branches, so that a block of them can be
+   vectorized */
+
+INLINE void
+sincos_wide(float a, float *s, float *c)
+{
+    double n, r, z, sr, cr, u, v;
+    int q;
+
+    n = (a * 6.36619772367581382433e-01 + 0x1.8p52) - 0x1.8p52;
+    q = (int)n & 3;
+
+    r = a - n * 1.57079632673412561417e+00;
+    r = r - n * 6.07710050650619224932e-11;
+    z = r * r;
+
+    sr = -2.50507602534068634195e-08 + z * 1.58969099521155010221e-10;
+    sr = 2.75573137070700676789e-06 + z * sr;
+    sr = -1.98412698298579493134e-04 + z * sr;
+    sr = 8.33333333332248946124e-03 + z * sr;
+    sr = -1.66666666666666324348e-01 + z * sr;
+    sr = r + r * z * sr;
+
+    cr = 2.08757232129817482790e-09 + z * -1.13596475577881948265e-11;
+    cr = -2.75573143513906633035e-07 + z * cr;
+    cr = 2.48015872894767294178e-05 + z * cr;
+    cr = -1.38888888888741095749e-03 + z * cr;
+    cr = 4.16666666666666019037e-02 + z * cr;
+    cr = 1 - 0.5 * z + z * z * cr;
+
+    /* selects by multiplying with 0, 1 and -1, which is exact and, unlike a
+       conditional, vectorized without -fno-trapping-math */
+    u = q & 1;
+    v = 1 - (q & 2);
+
+    *s = v * (sr * (1 - u) + cr * u);
+    *c = v * (cr * (1 - u) - sr * u);
+}
+
+INLINE void
+warp_wide(uint8_t *restrict row, int y, int from, int step, const struct warp *restrict w)
+{
+    float A[LANES], R[LANES], X[LANES], Y[LANES], ox, oy, s, c;
+    int i, k, m, x, sx, sy;
+    const float *polar;
+    const uint8_t *p;
+
+    polar = w->polar + 2 * y * bw;
+
+    ox = w->zoom * sh * w->ox;
+    oy = w->zoom * sh * w->oy;
+
+    for (x = from; x < bw; x += step * LANES)
+    {
+        m = (bw - x + step - 1) / step;
+
+        for (k = 0; k < LANES; ++k)
+        {
+            i = k < m ? x + k * step : x;
+
+            A[k] = polar[2 * i + 0] + w->roto;
+            R[k] = polar[2 * i + 1] * w->zoom;
+        }
+
+        for (k = 0; k < LANES; ++k)
+        {
+            sincos_wide(A[k], &s, &c);
+
+            X[k] = R[k] * c + ox;
+            Y[k] = R[k] * s + oy;
+        }
+
+        for (k = 0; k < LANES && k < m; ++k)
+        {
+            i = x + k * step;
+
+            sx = (((int)X[k] + ts / 2) + 16 * ts) % ts;
+            sy = (((int)Y[k] + ts / 2) + 16 * ts) % ts;
+
+            p = w->texture + 3 * (sy * ts + sx);
+
+            if (p[0] == 32)
+            {
+                row[i * 3 + 0] = w->flash;
+                row[i * 3 + 1] = w->flash;
+                row[i * 3 + 2] = w->flash;
+            }
+            else
+            {
+                row[i * 3 + 0] = p[0];
+                row[i * 3 + 1] = p[1];
+                row[i * 3 + 2] = p[2];
+            }
+        }
+    }
+}
+
+INLINE void
+bgr_wide(uint8_t *restrict out, const uint8_t *restrict in, int n)
+{
+    int k, x;
+
+    for (x = 0; x + LANES <= n; x += LANES)
+    {
+        for (k = x; k < x + LANES; ++k)
+        {
+            out[3 * k + 0] = in[3 * k + 2];
+            out[3 * k + 1] = in[3 * k + 1];
+            out[3 * k + 2] = in[3 * k + 0];
+        }
+    }
+
+    for (; x < n; ++x)
+    {
+        out[3 * x + 0] = in[3 * x + 2];
+        out[3 * x + 1] = in[3 * x + 1];
+        out[3 * x + 2] = in[3 * x + 0];
+    }
+}
+
+////////////////////////////////////////////////////////////////////////
+
+#define VARIANT(isa, flags, check)                                                              \
+    static __attribute__((target(flags))) void                                                  \
+    isa##_escape(uint8_t *iter, const float *re, float im, int from, int step, int n, int deep) \
+    {                                                                                           \
+        escape_wide(iter, re, im, from, step, n, deep);                                         \
+    }                                                                                           \
+                                                                                                \
+    static __attribute__((target(flags))) void                                                  \
+    isa##_warp(uint8_t *row, int y, int from, int step, const struct warp *w)                   \
+    {                                                                                           \
+        warp_wide(row, y, from, step, w);                                                       \
+    }                                                                                           \
+                                                                                                \
+    static __attribute__((target(flags))) void                                                  \
+    isa##_fire(uint8_t *row, const uint8_t *above, const uint8_t *above2, int n)                \
+    {                                                                                           \
+        fire_wide(row, above, above2, n);                                                       \
+    }                                                                                           \
+                                                                                                \
+    static __attribute__((target(flags))) void                                                  \
+    isa##_bgr(uint8_t *out, const uint8_t *in, int n)                                           \
+    {                                                                                           \
+        bgr_wide(out, in, n);                                                                   \
+    }                                                                                           \
+                                                                                                \
+    static int                                                                                  \
+    isa##_supported()                                                                           \
+    {                                                                                           \
+        return check;                                                                           \
+    }                                                                                           \
+                                                                                                \
+    static const struct kernels isa##_kernels = {                                               \
+        #isa, isa##_supported, isa##_escape, isa##_warp, isa##_fire, isa##_bgr                        \
+    };
+
+#ifdef X86
+VARIANT(avx512, "avx512f,avx512bw,avx512vl,avx2",
+        __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512vl"))
+VARIANT(avx2, "avx2", __builtin_cpu_supports("avx2"))
+#endif
+
+static void
+generic_escape(uint8_t *iter, const float *re, float im, int from, int step, int n, int deep)
+{
+    escape_wide(iter, re, im, from, step, n, deep);
+}
+
+static void
+generic_warp(uint8_t *row, int y, int from, int step, const struct warp *w)
+{
+    warp_wide(row, y, from, step, w);
+}
+
+static void
+generic_fire(uint8_t *row, const uint8_t *above, const uint8_t *above2, int n)
+{
+    fire_wide(row, above, above2, n);
+}
+
+static void
+generic_bgr(uint8_t *out, const uint8_t *in, int n)
+{
+    bgr_wide(out, in, n);
+}
+
+static int
+generic_supported()
+{
+    return 1;
+}
+
+static const struct kernels generic_kernels = {
+    "generic", generic_supported, generic_escape, generic_warp, generic_fire, generic_bgr
+};
+
+////////////////////////////////////////////////////////////////////////
+
+const struct kernels *const kernel_variants[] = {
+#ifdef X86
+    &avx512_kernels,
+    &avx2_kernels,
+#endif
+    &generic_kernels,
+    &reference_kernels,
+    NULL
+};
+
+const struct kernels *kernels = &reference_kernels;
+
+void
+kernels_init()
+{
+    const struct kernels *const *k;
+    const char *isa;
+
+    isa = getenv("EUCLID_ISA");
+
+    for (k = kernel_variants; *k; ++k)
+    {
+        if (isa && *isa && strcmp(isa, (*k)->name))
+            continue;
+
+        if (!(*k)->supported())
+        {
+            if (isa && *isa)
+                errx(EXIT_FAILURE, "EUCLID_ISA=%s: not supported by this cpu", isa);
+
+            continue;
+        }
+
+        kernels = *k;
+        return;
+    }
+
+    errx(EXIT_FAILURE, "EUCLID_ISA=%s: unknown kernels", isa);
+}
@@ -0,0 +1,25 @@
+struct warp
+{
+    const uint8_t *texture;
+    const float *polar;
+    double phase;
+    float roto, zoom;
+    float ox, oy;
+    uint8_t flash;
+};
+
+struct kernels
+{
+    const char *name;
+    int (*supported)();
+    void (*escape)(uint8_t *iter, const float *re, float im, int from, int step, int n, int deep);
+    void (*warp)(uint8_t *row, int y, int from, int step, const struct warp *w);
+    void (*fire)(uint8_t *row, const uint8_t *above, const uint8_t *above2, int n);
+    void (*bgr)(uint8_t *out, const uint8_t *in, int n);
+};
+
+extern const struct kernels *const kernel_variants[];
+extern const struct kernels reference_kernels;
+extern const struct kernels *kernels;
+
+void kernels_init();
@@ -0,0 +1,93 @@
+#include <math.h>
+#include <stdint.h>
+
+#include "effects.h"
+#include "lsys.h"
+
+////////////////////////////////////////////////////////////////////////
+
+#define MIN_SEGMENT 3
+
+////////////////////////////////////////////////////////////////////////
+
+int
+lsys_depth(float length, float pixels)
+{
+    int depth;
+
+    for (depth = LSYS_MAX_DEPTH; depth > 2; --depth)
+        if (length / pow(3, depth) * pixels >= MIN_SEGMENT)
+            break;
+
+    return depth;
+}
+
+int
+lsys_count(const struct lsys *l, int depth)
+{
+    int count;
+
+    for (count = l->sides; depth; --depth)
+        count *= l->children;
+
+    return count;
+}
+
+static float
+child(const struct lsys *l, float length, int bend, int k)
+{
+    float d;
+
+    d = length / 3;
+
+    return bend ? d : d * l->grow[k];
+}
+
+void
+lsys_expand(const struct lsys *l, struct point *out, float length, float x, float y, int m, int n)
+{
+    float len[LSYS_MAX_DEPTH + 1];
+    int digit[LSYS_MAX_DEPTH];
+    int depth, i, j, side;
+    float a;
+
+    depth = m + n;
+    a = 0;
+
+    for (side = 0; side < l->sides; ++side)
+    {
+        len[0] = length;
+
+        for (j = 0; j < depth; ++j)
+        {
+            digit[j] = 0;
+            len[j + 1] = child(l, len[j], j < n, 0);
+        }
+
+        for (;;)
+        {
+            x += len[depth] * cos(a);
+            y += len[depth] * sin(a);
+
+            out->x = x;
+            out->y = y;
+            ++out;
+
+            for (j = depth - 1; j >= 0 && digit[j] == l->children - 1; --j)
+                digit[j] = 0;
+
+            if (j < 0)
+                break;
+
+            if (j < n)
+                a += l->turn[digit[j]];
+
+            ++digit[j];
+
+            for (i = j; i < depth; ++i)
+                len[i + 1] = child(l, len[i], i < n, digit[i]);
+        }
+
+        a += TAU / l->sides;
+    }
+}
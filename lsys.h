@@ -0,0 +1,13 @@
+#define LSYS_MAX_DEPTH 8
+
+struct lsys
+{
+    int sides;
+    int children;
+    float grow[5];
+    double turn[4];
+};
+
+int lsys_depth(float length, float pixels);
+int lsys_count(const struct lsys *l, int depth);
+void lsys_expand(const struct lsys *l, struct point *out, float length, float x, float y, int m, int n);
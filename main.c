@@ -1,18 +1,32 @@
 #define _XOPEN_SOURCE
 
 #include <err.h>
+#include <getopt.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
+#include <unistd.h>
 
 #include <GL/gl.h>
 #include <GL/glut.h>
 
+#include "arena.h"
 #include "audio.h"
+#include "cache.h"
+#include "clock.h"
+#include "effects.h"
+#include "kernels.h"
+#include "onset.h"
+#include "perf.h"
+#include "pool.h"
+#include "queue.h"
+#include "serve.h"
+#include "stats.h"
 #include "tga.h"
+#include "timeline.h"
+#include "trace.h"
 
 ////////////////////////////////////////////////////////////////////////
 
@@ -20,1022 +34,240 @@
 
 #define UNUSED(x) (void)(x)
 
-#define TAU 6.283185307179586
-
 ////////////////////////////////////////////////////////////////////////
 
-struct point
-{
-    float x, y;
-};
-
-////////////////////////////////////////////////////////////////////////
-
-static struct point koch0_points[768];
-static struct point koch1_points[768];
-static struct point koch2_points[768];
-static struct point koch3_points[768];
-static struct point koch4_points[768];
-
-static struct point qoch0_points[16000];
-static struct point qoch1_points[16000];
-static struct point qoch2_points[16000];
-static struct point qoch3_points[16000];
-static struct point qoch4_points[16000];
-
-static uint8_t **flame;
-
-static uint8_t mandl_palette[256][3];
-static uint8_t flame_palette[256][3];
-
-uint8_t *kochz;
-uint8_t *qochz;
-
-static uint8_t *pixels;
+static struct frame *scratch;
+static struct frame *history;
 
 static uint8_t *frame;
 
-static struct point *points;
-static int numpoints = 0;
-static float t_a, t_x, t_y;
+static float period = 1.0 / 60;
 
-static double started = -1;
-
-static const int quality = 4;
-static int bw, bh;
-static int sw, sh;
-
-////////////////////////////////////////////////////////////////////////
+static float start = -2;
+static float end = INFINITY;
 
-static void
-hsl2rgb(uint8_t rgb[3], float h, float s, float l) {
-    float v;
-    float r, g, b;
-
-    r = l;
-    g = l;
-    b = l;
-    v = (l <= 0.5) ? (l * (1.0 + s)) : (l + s - l * s);
-    if (v > 0)
-    {
-        double m;
-        double sv;
-        int sextant;
-        double fract, vsf, mid1, mid2;
-
-        m = l + l - v;
-        sv = (v - m ) / v;
-        h *= 6.0;
-        sextant = (int)h;
-        fract = h - sextant;
-        vsf = v * sv * fract;
-        mid1 = m + vsf;
-        mid2 = v - vsf;
-        switch (sextant)
-        {
-        case 0:
-            r = v;
-            g = mid1;
-            b = m;
-            break;
-        case 1:
-            r = mid2;
-            g = v;
-            b = m;
-            break;
-        case 2:
-            r = m;
-            g = v;
-            b = mid1;
-            break;
-        case 3:
-            r = m;
-            g = mid2;
-            b = v;
-            break;
-        case 4:
-            r = mid1;
-            g = m;
-            b = v;
-            break;
-        case 5:
-            r = v;
-            g = m;
-            b = mid2;
-            break;
-        }
-    }
+static int checkerboard = 0;
+static int overlay = 0;
 
-    rgb[0] = 255 * r;
-    rgb[1] = 255 * g;
-    rgb[2] = 255 * b;
-}
-
-float
-lerp(float a, float b, float t) {
-    return a + (b - a) * t;
-}
-
-float
-smoothstep(float x)
-{
-    return x * x * (3 - 2 * x);
-}
+static FILE *timestamps = NULL;
 
 ////////////////////////////////////////////////////////////////////////
 
-#if 1
 static float
 elapsed()
 {
-    struct timeval tv;
-    double now;
-
-    gettimeofday(&tv, NULL);
-
-    now = tv.tv_sec + tv.tv_usec * 1e-6;
-
-    if (started == -1)
-        started = now;
-
-    return now - started;
-}
-#else
-static float
-elapsed()
-{
-    return alsa_offset() / 44100.0;
+    return clock_now();
 }
-#endif
-
-////////////////////////////////////////////////////////////////////////
 
 static void
-make_mandelbrot()
+report()
 {
-    float h, s, l, x;
-    int i;
-
-    for (i = 0; i < 192; ++i)
-    {
-        x = (float)i / 192;
+    double ppm, offset;
 
-        h = fmodf(powf(2 - x, 2), .8);
-        s = 1;
-        l = 0.5 * powf(h + .1, .1);
+    clock_drift(&ppm, &offset);
 
-        hsl2rgb(mandl_palette[i], h, s, l);
-    }
-
-    mandl_palette[191][0] = 0;
-    mandl_palette[191][1] = 0;
-    mandl_palette[191][2] = 0;
-}
-
-static void
-draw_mandelbrot(float cx, float cy, float scale, float d, float t)
-{
-    float a, b, za, zb, zaa, zbb, dx, dy;
-    int R, G, B;
-    int i, x, y;
-
-    if (t > .95)
-        d = 20 * (t - .95);
-
-    d = pow(d, .5);
-
-    for(y = 0; y < bh; ++y) {
-        b = cy + scale * (1 - 2 * (float)y / bh);
-
-        for (x = 0; x < bw; ++x)
-        {
-            a = cx + bw * scale / bh * (-1 + 2 * (float)x / bw);
-
-            i = 192;
-
-            if (scale < 2. / 100)
-            {
-
-                dx = a + 0.6506;
-                dy = b + 0.4780;
-
-                if (dx * dx + dy * dy < 0.0000007)
-                    goto setpixel;
-
-                dx = a + 0.64915;
-                dy = b + 0.47855;
-
-                if (dx * dx + dy * dy < 0.0000002)
-                    goto setpixel;
-            }
-            else
-            {
-                dx = a + 0.25;
-                dy = b + 0.0;
-
-                if (dx * dx + dy * dy < 0.23)
-                    goto setpixel;
-
-                dx = a + 1;
-                dy = b + 0;
-
-                if (dx * dx + dy * dy < 0.05)
-                    goto setpixel;
-
-                dx = a + 0.623;
-                dy = b + 0.425;
-
-                if (dx * dx + dy * dy < 0.00035)
-                    goto setpixel;
-            }
-
-            za = a;
-            zb = b;
-
-            for (i = 0; i < 192; ++i)
-            {
-                zaa = za * za;
-                zbb = zb * zb;
-
-                if (zaa + zbb > 4)
-                    break;
-
-                zb = (2 * (za * zb)) + b;
-                za = zaa - zbb + a;
-            }
-
-setpixel:
-            if (i == 192)
-            {
-                i = rand() % 48;
-
-                i -= 48 * d;
-
-                if (i < 0)
-                    i = 0;
-
-                pixels[y * bw * 3 + x * 3 + 0] = i;
-                pixels[y * bw * 3 + x * 3 + 1] = i;
-                pixels[y * bw * 3 + x * 3 + 2] = i;
-            }
-            else
-            {
-                R = mandl_palette[i][0];
-                G = mandl_palette[i][1];
-                B = mandl_palette[i][2];
-                R -= 256 * d; if (R < 0) R = 0;
-                G -= 256 * d; if (G < 0) G = 0;
-                B -= 256 * d; if (B < 0) B = 0;
-                pixels[y * bw * 3 + x * 3 + 0] = R;
-                pixels[y * bw * 3 + x * 3 + 1] = G;
-                pixels[y * bw * 3 + x * 3 + 2] = B;
-            }
-        }
-    }
-
-    glPixelZoom((float)sw / bw, (float)sh / bh);
-    glDrawPixels(bw, bh, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    fprintf(stderr, "audio clock drift %+.1f ppm, offset %+.2f ms, %u underruns\n",
+            ppm, offset * 1e3, alsa_underruns());
 }
 
 ////////////////////////////////////////////////////////////////////////
 
 static void
-forward(float d)
+open_audio(void *arg)
 {
-    t_x += d * cos(t_a);
-    t_y += d * sin(t_a);
-}
+    UNUSED(arg);
 
-static void
-point()
-{
-    points->x = t_x;
-    points->y = t_y;
-    ++points;
+    alsa_init();
+    alsa_open("euclid.ogg", start + 2, end + 2);
 }
 
 static void
-morph(float *x, float *y, struct point *a, struct point *b, float t)
+upload(const uint8_t *buf)
 {
-    float x0, y0, x1, y1;
-
-    x0 = a->x;
-    y0 = a->y;
-    x1 = b->x;
-    y1 = b->y;
-
-    *x = lerp(x0, x1, smoothstep(t));
-    *y = lerp(y0, y1, smoothstep(t));
+    glRasterPos2f(-1, -1);
+    glPixelZoom((float)sw / bw, (float)sh / bh);
+    glDrawPixels(bw, bh, GL_RGB, GL_UNSIGNED_BYTE, buf);
 }
 
 ////////////////////////////////////////////////////////////////////////
 
 static void
-koch(float length, int m, int n)
+account(const struct perf_sample *sample, float t)
 {
-    float d;
-
-    d = length / 3;
+    float from, to;
+    int scene;
 
-    if (!n)
-    {
-        if (!m)
-        {
-            forward(length);
-            point();
-            return;
-        }
-
-        koch(d, m - 1, n);
-        koch(d / 2, m - 1, n);
-        koch(d / 2, m - 1, n);
-        koch(d, m - 1, n);
-
-        return;
-    }
-
-    koch(d, m, n - 1);
-    t_a -= TAU / 6;
-    koch(d, m, n - 1);
-    t_a += TAU / 3;
-    koch(d, m, n - 1);
-    t_a -= TAU / 6;
-    koch(d, m, n - 1);
+    if (0 <= (scene = timeline_scene(t, &from, &to)))
+        perf_end(sample, scene, from, to);
 }
 
-static void
-make_koch()
+static int
+render(float t, int n, struct frame *f, int serial)
 {
-    int i;
+    struct perf_sample sample;
+    int ok;
 
-    numpoints = 0;
-    points = koch0_points;
+    f->parity = checkerboard ? n & 1 : -1;
 
-    t_a = 0;
-    t_x = -.6;
-    t_y = -.35;
+    perf_begin(&sample);
 
-    for (i = 0; i < 3; ++i)
-    {
-        koch(1.2, 4, 0);
-        t_a += TAU / 3;
-    }
+    if ((ok = timeline_render(t, f, serial)))
+        account(&sample, t);
 
-    numpoints = 0;
-    points = koch1_points;
-
-    t_a = 0;
-    t_x = -.6;
-    t_y = -.35;
-
-    for (i = 0; i < 3; ++i)
-    {
-        koch(1.2, 3, 1);
-        t_a += TAU / 3;
-    }
-
-    numpoints = 0;
-    points = koch2_points;
-
-    t_a = 0;
-    t_x = -.6;
-    t_y = -.35;
-
-    for (i = 0; i < 3; ++i)
-    {
-        koch(1.2, 2, 2);
-        t_a += TAU / 3;
-    }
-
-    numpoints = 0;
-    points = koch3_points;
-
-    t_a = 0;
-    t_x = -.6;
-    t_y = -.35;
-
-    for (i = 0; i < 3; ++i)
-    {
-        koch(1.2, 1, 3);
-        t_a += TAU / 3;
-    }
-
-    numpoints = 0;
-    points = koch4_points;
-
-    t_a = 0;
-    t_x = -.6;
-    t_y = -.35;
-
-    for (i = 0; i < 3; ++i)
-    {
-        koch(1.2, 0, 4);
-        t_a += TAU / 3;
-    }
+    return ok;
 }
 
-static void
-draw_koch(float t)
+static int
+render_ahead(float t, int n, void *buf)
 {
-    float x, y;
-    int i;
+    double begin;
+    int ok;
 
-    glBegin(GL_LINE_LOOP);
-    glColor3f(1.0, 1.0, 1.0);
-    for (i = 0; i < 768; ++i)
-    {
-        if (t < .25)
-            morph(&x, &y, koch0_points + i, koch1_points + i, (t - .00) * 4);
-        else if (t < .50)
-            morph(&x, &y, koch1_points + i, koch2_points + i, (t - .25) * 4);
-        else if (t < .75)
-            morph(&x, &y, koch2_points + i, koch3_points + i, (t - .50) * 4);
-        else
-            morph(&x, &y, koch3_points + i, koch4_points + i, (t - .75) * 4);
+    begin = trace_begin();
+    ok = render(t, n, buf, 0);
+    trace_end("render ahead", begin);
 
-        glVertex2f(x * sh / sw, y);
-    }
-    glEnd();
+    return ok;
 }
 
-////////////////////////////////////////////////////////////////////////
-
 static void
-make_kochz()
+present(struct frame *f)
 {
-    int x, y, X, Y;
-    uint8_t *p;
+    double begin;
 
-    glClearColor(0, 0, 0, 1);
-    glClear(GL_COLOR_BUFFER_BIT);
-    draw_koch(1);
-    glFlush();
-    glFinish();
-    glReadPixels((sw - sh) / 2, 0, sh, sh, GL_RGB, GL_UNSIGNED_BYTE, kochz);
+    begin = trace_begin();
+    reconstruct(f, history);
+    trace_end("reconstruct", begin);
 
-    for (y = 0; y < sh; ++y)
-    {
-        for (x = 0; x < sh; ++x)
-        {
-            p = kochz + 3 * (y * sh + x);
-
-            if (p[3 +  0] || p[3 * sh +  0]) p[0] = 255, p[1] = 255, p[2] = 255;
-            if (p[3 +  3] || p[3 * sh +  3]) p[0] = 255, p[1] = 255, p[2] = 255;
-            if (p[3 +  6] || p[3 * sh +  6]) p[0] = 255, p[1] = 255, p[2] = 255;
-            if (p[3 +  9] || p[3 * sh +  9]) p[0] = 255, p[1] = 220, p[2] = 150;
-            if (p[3 + 12] || p[3 * sh + 12]) p[0] = 255, p[1] = 192, p[2] = 128;
+    begin = trace_begin();
+    upload(f->pixels);
+    trace_end("upload", begin);
 
-            X = (x / (sh >> 2)) % 2;
-            Y = (y / (sh >> 2)) % 2;
-            if (!p[0] && (X ^ Y))
-            {
-                p[0] = 32;
-                p[1] = 32;
-                p[2] = 32;
-            }
-        }
-    }
+    memcpy(history, f, sizeof(struct frame) + bh * bw * 3);
 }
 
 static void
-draw_kochz(float t)
+draw_overlay()
 {
-    float ox, oy, roto, zoom;
-    float X, Y, a, r;
-    float u;
-    int sx, sy, x, y;
-    uint8_t *p, q;
-
-    u = elapsed();
-
-    if (u > 34)
-        q = 64 + 32 * pow(1 - fmod(u - 0.133976, 0.472667) / 0.2, 4);
-    else
-        q = 32;
-
-    if (t < .25)
-        ox = 0, oy = 0, roto = 0, zoom = 4;
-    else if (t < .5)
-        ox = 0, oy = 0, roto = 0, zoom = 12;
-    else
-    {
-        t = 2 * (t - .5);
-        ox = lerp(0, .25, t);
-        oy = lerp(0, .25, t);
-        roto = lerp(0, 24, t);
-        zoom = lerp(12, 2, t);
-    }
-
-    for (y = 0; y < bh; ++y)
-    {
-        for (x = 0; x < bw; ++x)
-        {
-            X = x - bw / 2;
-            Y = y - bh / 2;
-
-            a = TAU / 4 + atan2(X, Y);
-            r = sqrtf(X * X + Y * Y);
-
-            a += roto;
-            r *= zoom;
+    char text[64], *c;
 
-            X = r * cosf(a) + zoom * sh * ox;
-            Y = r * sinf(a) + zoom * sh * oy;
+    stats_summary(text, sizeof(text));
 
-            sx = ((int)X + sh / 2) % sh;
-            sy = (((int)Y + sh / 2) + 16 * sh) % sh;
+    glColor3f(0, 1, 0);
+    glRasterPos2f(-.98, .94);
 
-            p = kochz + 3 * (sy * sh + sx);
-
-            if (p[0] == 32)
-            {
-                pixels[y * bw * 3 + x * 3 + 0] = q;
-                pixels[y * bw * 3 + x * 3 + 1] = q;
-                pixels[y * bw * 3 + x * 3 + 2] = q;
-            }
-            else
-            {
-                pixels[y * bw * 3 + x * 3 + 0] = p[0];
-                pixels[y * bw * 3 + x * 3 + 1] = p[1];
-                pixels[y * bw * 3 + x * 3 + 2] = p[2];
-            }
-        }
-    }
-
-    glPixelZoom((float)sw / bw, (float)sh / bh);
-    glDrawPixels(bw, bh, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    for (c = text; *c; ++c)
+        glutBitmapCharacter(GLUT_BITMAP_9_BY_15, *c);
 }
 
-////////////////////////////////////////////////////////////////////////
-
 static void
-qoch(float length, int m, int n)
-{
-    float d;
-
-    d = length / 3;
-
-    if (!n)
-    {
-        if (!m)
-        {
-            forward(length);
-            point();
-            return;
-        }
-
-        qoch(d, m - 1, n);
-        qoch(0, m - 1, n);
-        qoch(d, m - 1, n);
-        qoch(0, m - 1, n);
-        qoch(d, m - 1, n);
-
-        return;
-    }
+display(void) {
+    static int frames = 0;
+    static float last = -1;
 
-    qoch(d, m, n - 1);
-    t_a -= TAU / 4;
-    qoch(d, m, n - 1);
-    t_a += TAU / 4;
-    qoch(d, m, n - 1);
-    t_a += TAU / 4;
-    qoch(d, m, n - 1);
-    t_a -= TAU / 4;
-    qoch(d, m, n - 1);
-}
+    struct perf_sample sample;
+    double begin, stage;
+    float t, from, to;
+    struct frame *buf;
+    int drawn, scene;
 
-static void
-make_qoch()
-{
-    static const float x = -.5;
-    static const float y = -.5;
-    int i;
+    begin = trace_begin();
 
-    points = qoch0_points;
-    t_a = 0; t_x = x; t_y = y;
-    for (i = 0; i < 4; ++i)
-    {
-        qoch(1.0, 4, 0);
-        t_a += TAU / 4;
-    }
+    if (RECORD)
+        t = start + (float)frames / 30;
+    else
+        t = elapsed() - 2;
 
-    points = qoch1_points;
-    t_a = 0; t_x = x; t_y = y;
-    for (i = 0; i < 4; ++i)
-    {
-        qoch(1.0, 3, 1);
-        t_a += TAU / 4;
-    }
+    if (t >= end || timeline_done(t))
+        exit(EXIT_SUCCESS);
 
-    points = qoch2_points;
-    t_a = 0; t_x = x; t_y = y;
-    for (i = 0; i < 4; ++i)
-    {
-        qoch(1.0, 2, 2);
-        t_a += TAU / 4;
-    }
+    if (timestamps)
+        fprintf(timestamps, "%.6f %.6f\n", t, RECORD ? 0 : alsa_offset());
 
-    points = qoch3_points;
-    t_a = 0; t_x = x; t_y = y;
-    for (i = 0; i < 4; ++i)
-    {
-        qoch(1.0, 1, 3);
-        t_a += TAU / 4;
-    }
+    if (last != -1 && t > last)
+        period = lerp(period, fmin(fmax(t - last, 1.0 / 240), 1.0 / 10), .1);
 
-    points = qoch4_points;
-    t_a = 0; t_x = x; t_y = y;
-    for (i = 0; i < 4; ++i)
-    {
-        qoch(1.0, 0, 4);
-        t_a += TAU / 4;
-    }
-}
+    last = t;
 
-static void
-draw_qoch(float t)
-{
-    float x, y;
-    int i;
+    stage = trace_begin();
+    timeline_prepare(t);
+    queue_schedule(frames, t, period);
+    trace_end("schedule", stage);
 
-    glBegin(GL_LINE_LOOP);
-    glColor3f(0.0, 0.0, 0.0);
-    for (i = 0; i < 2500; ++i)
+    if (NULL != (buf = queue_take(t, period / 2)))
     {
-        if (t < .25)
-            morph(&x, &y, qoch0_points + i, qoch1_points + i, (t - .00) * 4 + 0.13 * sin(200*t));
-        else if (t < .50)
-            morph(&x, &y, qoch1_points + i, qoch2_points + i, (t - .25) * 4 + 0.13 * sin(200*t));
-        else if (t < .75)
-            morph(&x, &y, qoch2_points + i, qoch3_points + i, (t - .50) * 4 + 0.13 * sin(200*t));
-        else
-            morph(&x, &y, qoch3_points + i, qoch4_points + i, (t - .75) * 4 + 0.13 * sin(200*t));
-
-        glVertex2f(x * sh / sw, y);
+        present(buf);
+        queue_release(buf);
     }
-    glEnd();
-}
-
-////////////////////////////////////////////////////////////////////////
-
-static void
-make_qochz()
-{
-    int x, y, X, Y;
-    uint8_t *p;
-
-    glClearColor(1, 1, 1, 1);
-    glClear(GL_COLOR_BUFFER_BIT);
-    draw_qoch(1);
-    glFlush();
-    glFinish();
-    glReadPixels((sw - sh) / 2, 0, sh, sh, GL_RGB, GL_UNSIGNED_BYTE, qochz);
-
-    for (y = 0; y < sh; ++y)
-    {
-        for (x = 0; x < sh; ++x)
-        {
-            p = qochz + 3 * (y * sh + x);
-
-            if (!p[3 +  0] || !p[3 * sh +  0]) p[0] = 0, p[1] = 0, p[2] = 0;
-
-            X = (x / (sh >> 2)) % 2;
-            Y = (y / (sh >> 2)) % 2;
-            if (p[0] == 255 && (X ^ Y))
-            {
-                p[0] = 224;
-                p[1] = 224;
-                p[2] = 224;
-            }
-        }
-    }
-}
-
-static void
-draw_qochz(float t)
-{
-    float ox, oy, roto, zoom;
-    float X, Y, a, r;
-    int sx, sy, x, y;
-    uint8_t *p;
-
-    if (t < .25)
-        ox = 0, oy = 0, roto = 0, zoom = 4;
-    else if (t < .5)
-        ox = 0, oy = 0, roto = 0, zoom = 12;
     else
     {
-        t = 2 * (t - .5);
-        ox = lerp(0, .14746, t);
-        oy = lerp(0, .22265, t);
-        roto = lerp(32, 0, t);
-        zoom = lerp(12, .5, t);
-    }
+        stage = trace_begin();
 
-    for (y = 0; y < bh; ++y)
-    {
-        for (x = 0; x < bw; ++x)
+        if (render(t, frames, scratch, 1))
         {
-            X = x - bw / 2;
-            Y = y - bh / 2;
-
-            a = atan2(X, Y);
-            r = sqrtf(X * X + Y * Y);
-
-            a += roto;
-            r *= zoom;
-
-            X = r * cosf(a) + zoom * sh * ox;
-            Y = r * sinf(a) + zoom * sh * oy;
-
-            sx = ((int)X + sh / 2) % sh;
-            sy = (((int)Y + sh / 2) + 16 * sh) % sh;
-
-            p = qochz + 3 * (sy * sh + sx);
-
-            pixels[y * bw * 3 + x * 3 + 0] = p[0];
-            pixels[y * bw * 3 + x * 3 + 1] = p[1];
-            pixels[y * bw * 3 + x * 3 + 2] = p[2];
+            trace_end("render", stage);
+            present(scratch);
         }
-    }
-
-    glPixelZoom((float)sw / bw, (float)sh / bh);
-    glDrawPixels(bw, bh, GL_RGB, GL_UNSIGNED_BYTE, pixels);
-}
-
-////////////////////////////////////////////////////////////////////////
-
-static void
-make_fire()
-{
-    float h, s, l, x;
-    int i;
-
-    for (i = 0; i < 256; ++i)
-    {
-        x = (float)i / 256;
-
-        h = powf(x, 1.3);
-        s = 1;
-        l = powf(x, .7);
-
-        hsl2rgb(flame_palette[i], h, s, l);
-    }
-}
-
-static void
-draw_euclid(int ceil)
-{
-    int x, y;
-
-    for (x =  50; x <  70; ++x) flame[140 * bh / 192][  x * bw / 256] = rand() % ceil;
-    for (x =  50; x <  70; ++x) flame[120 * bh / 192][  x * bw / 256] = rand() % ceil;
-    for (x =  50; x <  70; ++x) flame[100 * bh / 192][  x * bw / 256] = rand() % ceil;
-    for (y = 100; y < 140; ++y) flame[  y * bh / 192][ 50 * bw / 256] = rand() % ceil;
-
-    for (x =  80; x < 100; ++x) flame[100 * bh / 192][  x * bw / 256] = rand() % ceil;
-    for (y = 100; y < 140; ++y) flame[  y * bh / 192][ 80 * bw / 256] = rand() % ceil;
-    for (y = 100; y < 140; ++y) flame[  y * bh / 192][100 * bw / 256] = rand() % ceil;
-
-    for (x = 110; x < 130; ++x) flame[100 * bh / 192][  x * bw / 256] = rand() % ceil;
-    for (x = 110; x < 130; ++x) flame[140 * bh / 192][  x * bw / 256] = rand() % ceil;
-    for (y = 100; y < 140; ++y) flame[  y * bh / 192][110 * bw / 256] = rand() % ceil;
-
-    for (x = 140; x < 160; ++x) flame[100 * bh / 192][  x * bw / 256] = rand() % ceil;
-    for (y = 100; y < 140; ++y) flame[  y * bh / 192][140 * bw / 256] = rand() % ceil;
-
-    for (y = 100; y < 140; ++y) flame[  y * bh / 192][170 * bw / 256] = rand() % ceil;
-
-    for (y = 100; y < 140; ++y) flame[  y * bh / 192][170 * bw / 256] = rand() % ceil;
-    for (y = 100; y < 140; ++y)
-    {
-        flame[  y * bh / 192][180 * bw / 256] = rand() % ceil;
-
-        if (y < 120)
-            x = 180 + (y - 100);
         else
-            x = 220 - (y - 100);
-
-        flame[  y * bh / 192][  x * bw / 256] = rand() % ceil;
-    }
-}
-
-static void
-draw_fire(float t)
-{
-    int x, y;
-
-    if (t > 0 && t < 1)
-        draw_euclid(64);
-
-    for (y = bh - 1; y > 0; --y)
-    {
-        for (x = 0; x < bw; ++x)
         {
-            double a = 0;
-
-            a += 0.60 * flame[y - 1][x];
-
-            if (x > 0)
-                a += 0.05 * flame[y - 1][x - 1];
-
-            if (x < bw - 1)
-                a += 0.05 * flame[y - 1][x + 1];
-
-            if (y > 1)
+            perf_begin(&sample);
+            drawn = timeline_draw(t);
+            account(&sample, t);
+
+            if (drawn)
+                history->view.effect = EFFECT_NONE;
+            else if (history->view.effect != EFFECT_NONE)
+                upload(history->pixels);
+            else
             {
-                a += 0.20 * flame[y - 2][x];
-
-                if (x > 0)
-                    a += 0.05 * flame[y - 2][x - 1];
-
-                if (x < bw - 1)
-                    a += 0.05 * flame[y - 2][x + 1];
+                glClearColor(0, 0, 0, 0);
+                glClear(GL_COLOR_BUFFER_BIT);
             }
 
-            flame[y][x] = 0.99 * a;
-        }
-    }
-
-    for (x = 0; x < bw; ++x)
-        flame[0][x] = 0;
-
-    if (t > 0 && t < 1)
-        draw_euclid(128);
-
-    for (y = 0; y < bh; ++y)
-    {
-        for (x = 0; x < bw; ++x)
-        {
-            pixels[y * bw * 3 + x * 3 + 0] = flame_palette[flame[y][x]][0];
-            pixels[y * bw * 3 + x * 3 + 1] = flame_palette[flame[y][x]][1];
-            pixels[y * bw * 3 + x * 3 + 2] = flame_palette[flame[y][x]][2];
+            trace_end("draw", stage);
         }
     }
 
-    glPixelZoom((float)sw / bw, (float)sh / bh);
-    glDrawPixels(bw, bh, GL_RGB, GL_UNSIGNED_BYTE, pixels);
-
-    if (t < 1)
-        for (x = 0; x < bw; ++x)
-            flame[0][x] = rand();
-}
-
-////////////////////////////////////////////////////////////////////////
-
-static void
-tga_write(FILE *file, uint8_t *pixels, const uint16_t width, const uint16_t height)
-{
-    struct tga_header h;
-    uint8_t *p;
-    int i;
-
-    memset(&h, 0, sizeof(struct tga_header));
-    h.image_type = 2;
-    h.y_origin = 0;
-    h.image_width = width;
-    h.image_height = height;
-    h.pixel_depth = 24;
-    h.image_descriptor = 0;
-
-    if(1 != fwrite(&h, sizeof(struct tga_header), 1, file))
-        err(EXIT_FAILURE, "fwrite header");
-
-    p = pixels;
-
-    for(i = 0; i < width * height; ++i)
-    {
-        if(1 != fwrite(p + 2, 1, 1, file))
-            err(EXIT_FAILURE, "fwrite pixels");
-
-        if(1 != fwrite(p + 1, 1, 1, file))
-            err(EXIT_FAILURE, "fwrite pixels");
-
-        if(1 != fwrite(p + 0, 1, 1, file))
-            err(EXIT_FAILURE, "fwrite pixels");
-
-        p += 3;
-    }
-}
-
-////////////////////////////////////////////////////////////////////////
-
-static void
-display(void) {
-    static int frames = 0;
-
-    float t, u, x, y, z;
-
-    if (RECORD)
-        t = (float)frames / 30 - 2;
-    else
-        t = elapsed() - 2;
-
-    if (t < 0)
-    {
-        z = 2;
-        x = 0;
-        y = 0;
-
-        draw_mandelbrot(x, y, z, -.5 * t, 0);
-    }
-    else if (t < 16.5)
-    {
-        u = (t - 0) / (16.5 - 0);
-
-        z = pow(2, lerp(1, -12, u));
-        x = lerp(.0, -0.6506, 1 - z / 2);
-        y = lerp(.0, -0.4785, 1 - z / 2);
-
-        draw_mandelbrot(x, y, z, 0, u);
-    }
-    else if (t < 30)
-    {
-        u = (t - 16.5) / (30 - 16.5);
-
-        glClearColor(0.0, 0.0, 0.0, 1.0);
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        draw_koch(u);
-    }
-    else if (t < 57.73)
-    {
-        u = (t - 30) / (45 - 30);
-
-        draw_kochz(u);
-    }
-    else if (t < 66.06)
-    {
-        u = (t - 57.73) / (66.25 - 57.73);
-
-        draw_qochz(1 - u / 2);
-    }
-    else if (t < 66.28)
-    {
-        draw_qochz(.3);
-    }
-    else if (t < 66.8)
-    {
-        draw_qochz(0);
-    }
-    else if (t < 77)
-    {
-        u = (t - 65) / (77 - 65);
-
-        glClearColor(1.0, 1.0, 1.0, 0.0);
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        draw_qoch(1 - u);
-    }
-    else if (t < 80)
-    {
-        u = (t - 77) / (80 - 77);
-
-        glClearColor(1 - u, 1 - u, 1 - u, 0);
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        draw_qoch(0);
-    }
-    else if (t < 81.22)
-    {
-        glClearColor(0, 0, 0, 0);
-        glClear(GL_COLOR_BUFFER_BIT);
-    }
-    else if (t < 84.14)
-    {
-        draw_fire(0);
-    }
-    else if (t < 87.88)
-    {
-        draw_fire(.2);
-    }
-    else if (t < 93)
-    {
-        draw_fire(1);
-    }
-    else
-    {
-        exit(EXIT_SUCCESS);
-    }
+    if (overlay)
+        draw_overlay();
 
+    stage = trace_begin();
     glFlush();
     glFinish();
+    trace_end("finish", stage);
 
     if (RECORD)
     {
         FILE *f;
         char path[100];
 
+        stage = trace_begin();
         glReadPixels(0, 0, sw, sh, GL_RGB, GL_UNSIGNED_BYTE, frame);
+        trace_end("readback", stage);
+
+        stage = trace_begin();
         sprintf(path, "frame_%06d.tga", frames);
         f = fopen(path, "w");
         tga_write(f, frame, sw, sh);
         fclose(f);
-
-        ++frames;
+        trace_end("tga_write", stage);
     }
 
+    ++frames;
+
+    stage = trace_begin();
     glutSwapBuffers();
+    trace_end("swap", stage);
+
+    from = to = 0;
+    scene = timeline_scene(t, &from, &to);
+    stats_frame(scene, from, to, clock_monotonic());
+
+    stage = trace_begin();
+    clock_pace();
+    trace_end("sleep", stage);
+
+    trace_end("frame", begin);
 }
 
 static void
@@ -1055,35 +287,97 @@ reshape(int w, int h) {
 int
 main(int argc, char *argv[])
 {
-    int i;
+    static const struct option options[] = {
+        { "start", required_argument, NULL, 's' },
+        { "end",     required_argument, NULL, 'e' },
+        { "analyze", no_argument,       NULL, 'a' },
+        { "serve",   required_argument, NULL, 'S' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int analyze, buffers, c, readback, workers;
+    const char *server;
+    char *rest;
+    struct task audio;
+    size_t n, size;
+    float *pcm;
+    long rate;
+
+    analyze = 0;
+    server = NULL;
+
+    while (-1 != (c = getopt_long(argc, argv, "s:e:aS:", options, NULL)))
+    {
+        switch (c)
+        {
+        case 'a':
+            analyze = 1;
+            break;
+        case 'S':
+            server = optarg;
+            break;
+        case 's':
+            start = fmax(atof(optarg), -2);
+            break;
+        case 'e':
+            end = atof(optarg);
+            break;
+        default:
+            errx(EXIT_FAILURE, "usage: %s [--start SECONDS] [--end SECONDS] WIDTH HEIGHT | --analyze | --serve SOCKET", argv[0]);
+        }
+    }
 
-    if (argc != 3)
-        errx(EXIT_FAILURE, "usage: %s WIDTH HEIGHT", argv[0]);
+    if (analyze)
+    {
+        pcm = oggvorbis_decode("euclid.ogg", &rate, &n);
+        onset_analyze("euclid.ogg", pcm, n, rate);
+        free(pcm);
 
-    sw = atoi(argv[1]);
-    sh = atoi(argv[2]);
+        return EXIT_SUCCESS;
+    }
 
-    bw = sw / quality;
-    bh = sh / quality;
+    if (server)
+    {
+        kernels_init();
+        onset_load("euclid.ogg");
+        pool_init(0);
 
-    if (NULL == (flame = malloc(bh  * sizeof(uint8_t *))))
-        errx(EXIT_FAILURE, "malloc flame");
-    for (i = 0; i < bh; ++i)
-        if (NULL == (flame[i] = malloc(bw)))
-            errx(EXIT_FAILURE, "malloc flame");
+        serve(server);
+    }
 
-    if (NULL == (pixels = malloc(bh * bw * 3)))
-        errx(EXIT_FAILURE, "malloc pixels");
+    if (argc - optind != 2)
+        errx(EXIT_FAILURE, "usage: %s [--start SECONDS] [--end SECONDS] WIDTH HEIGHT | --analyze | --serve SOCKET", argv[0]);
 
-    if (RECORD)
-        if (NULL == (frame = malloc(sh * sw * 3)))
-            errx(EXIT_FAILURE, "malloc pixels");
+    effects_size(atoi(argv[optind]), atoi(argv[optind + 1]));
 
-    if (NULL == (kochz = malloc(sh * sh * 3)))
-        errx(EXIT_FAILURE, "malloc kochz");
+    kernels_init();
+    onset_load("euclid.ogg");
 
-    if (NULL == (qochz = malloc(sh * sh * 3)))
-        errx(EXIT_FAILURE, "malloc qochz");
+    cache_open(sw, sh, ts);
+
+    checkerboard = getenv("EUCLID_CHECKERBOARD") && atoi(getenv("EUCLID_CHECKERBOARD"));
+
+    if (getenv("EUCLID_STATS"))
+        stats_open(getenv("EUCLID_STATS"), getenv("EUCLID_REFRESH") ? atof(getenv("EUCLID_REFRESH")) : 0);
+
+    overlay = getenv("EUCLID_OVERLAY") && atoi(getenv("EUCLID_OVERLAY"));
+
+    if (getenv("EUCLID_PERF") && atoi(getenv("EUCLID_PERF")))
+        perf_open();
+
+    if (getenv("EUCLID_TRACE"))
+    {
+        trace_open(getenv("EUCLID_TRACE"));
+        trace_thread("display");
+    }
+
+    if (getenv("EUCLID_TIMESTAMPS"))
+    {
+        if (NULL == (timestamps = fopen(getenv("EUCLID_TIMESTAMPS"), "w")))
+            err(EXIT_FAILURE, "%s", getenv("EUCLID_TIMESTAMPS"));
+
+        fprintf(timestamps, "%d %d\n", sw, sh);
+    }
 
     putenv("__GL_SYNC_TO_VBLANK=1");
 
@@ -1106,17 +400,68 @@ main(int argc, char *argv[])
     glutKeyboardFunc(keyboard);
     glutReshapeFunc(reshape);
 
-    make_mandelbrot();
-    make_koch();
-    make_kochz();
-    make_qoch();
-    make_qochz();
-    make_fire();
+    if (RECORD)
+        workers = 0;
+    else if (getenv("EUCLID_WORKERS"))
+    {
+        workers = strtol(getenv("EUCLID_WORKERS"), &rest, 10);
+
+        if (!*getenv("EUCLID_WORKERS") || *rest)
+            errx(EXIT_FAILURE, "EUCLID_WORKERS=%s: not a number", getenv("EUCLID_WORKERS"));
+    }
+    else
+        workers = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+
+    if (workers < 0)
+        workers = 0;
+
+    size = (sizeof(struct frame) + bh * bw * 3 + 63) & ~(size_t)63;
+    buffers = arena_reserve("frames", (2 + (workers > 0 && !RECORD ? workers + 2 : 0)) * size);
+    readback = RECORD ? arena_reserve("readback", sh * sw * 3) : -1;
+    effects_reserve(workers + 1);
+
+    arena_map(getenv("EUCLID_HUGEPAGES") && atoi(getenv("EUCLID_HUGEPAGES")));
+
+    if (getenv("EUCLID_ARENA") && atoi(getenv("EUCLID_ARENA")))
+        arena_report();
+
+    scratch = arena_slot(buffers);
+    history = (struct frame *)((char *)scratch + size);
+
+    if (RECORD)
+        frame = arena_slot(readback);
+
+    pool_init(workers);
+
+    timeline_prepare(start);
 
     if (!RECORD)
     {
-        alsa_init();
-        alsa_play("euclid.ogg");
+        audio.run = open_audio;
+        audio.arg = NULL;
+        pool_submit(&audio);
+    }
+
+    timeline_wait(start);
+    timeline_warm_up(start);
+
+    if (!RECORD)
+        pool_wait(&audio);
+
+    clock_start(start + 2);
+
+    if (!RECORD)
+    {
+        if (getenv("EUCLID_FPS"))
+            clock_limit(atof(getenv("EUCLID_FPS")), 1);
+        else
+            clock_limit(getenv("EUCLID_REFRESH") ? atof(getenv("EUCLID_REFRESH")) : 60, 0);
+
+        queue_init(workers, workers + 2, size, (char *)scratch + 2 * size, render_ahead);
+
+        alsa_play();
+
+        atexit(report);
     }
 
     glutMainLoop();
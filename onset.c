@@ -0,0 +1,304 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <err.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "onset.h"
+
+////////////////////////////////////////////////////////////////////////
+
+#define WINDOW 2048
+#define RATE 100
+#define MAGIC "onsets2"
+
+#define TAU 6.283185307179586
+
+#define PEAK 3
+#define MEAN 10
+#define DELTA 0.05
+#define SPACING 10
+
+#define MIN(a,b) ((a)>(b)?(b):(a))
+#define MAX(a,b) ((a)<(b)?(b):(a))
+
+////////////////////////////////////////////////////////////////////////
+
+struct header
+{
+    char magic[8];
+    uint64_t size;
+    int64_t mtime;
+    uint32_t rate;
+    uint32_t count;
+};
+
+static float *levels;
+static int *last;
+static int count;
+
+////////////////////////////////////////////////////////////////////////
+
+static void
+sidecar(char *buf, size_t n, const char *path)
+{
+    if ((size_t)snprintf(buf, n, "%s.onsets", path) >= n)
+        errx(EXIT_FAILURE, "onsets: path too long");
+}
+
+static void
+stamp(struct header *h, const char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st))
+        return;
+
+    h->size = st.st_size;
+    h->mtime = st.st_mtime;
+}
+
+static void
+twiddles(float *wr, float *wi, int n)
+{
+    int j, m;
+
+    for (m = 1; m < n; m *= 2)
+    {
+        for (j = 0; j < m; ++j)
+        {
+            wr[m + j] = cos(-TAU / 2 * j / m);
+            wi[m + j] = sin(-TAU / 2 * j / m);
+        }
+    }
+}
+
+static void
+butterflies(float *restrict ar, float *restrict ai, float *restrict br, float *restrict bi,
+            const float *restrict wr, const float *restrict wi, int m)
+{
+    float tr, ti;
+    int j, k;
+
+    for (j = 0; j < m; j += 16)
+    {
+        for (k = j; k < j + 16; ++k)
+        {
+            tr = br[k] * wr[k] - bi[k] * wi[k];
+            ti = br[k] * wi[k] + bi[k] * wr[k];
+
+            br[k] = ar[k] - tr;
+            bi[k] = ai[k] - ti;
+            ar[k] += tr;
+            ai[k] += ti;
+        }
+    }
+}
+
+static void
+fft(float *re, float *im, const float *wr, const float *wi, int n)
+{
+    float tr, ti;
+    int i, j, k, m;
+
+    for (i = 1, j = 0; i < n; ++i)
+    {
+        for (k = n >> 1; j & k; k >>= 1)
+            j ^= k;
+
+        j ^= k;
+
+        if (i < j)
+        {
+            tr = re[i], re[i] = re[j], re[j] = tr;
+            ti = im[i], im[i] = im[j], im[j] = ti;
+        }
+    }
+
+    for (m = 1; m < n; m *= 2)
+    {
+        for (i = 0; i < n; i += 2 * m)
+        {
+            if (m >= 16)
+            {
+                butterflies(re + i, im + i, re + i + m, im + i + m, wr + m, wi + m, m);
+                continue;
+            }
+
+            for (j = 0; j < m; ++j)
+            {
+                tr = re[i + j + m] * wr[m + j] - im[i + j + m] * wi[m + j];
+                ti = re[i + j + m] * wi[m + j] + im[i + j + m] * wr[m + j];
+
+                re[i + j + m] = re[i + j] - tr;
+                im[i + j + m] = im[i + j] - ti;
+                re[i + j] += tr;
+                im[i + j] += ti;
+            }
+        }
+    }
+}
+
+void
+onset_analyze(const char *path, const float *pcm, size_t n, long rate)
+{
+    float re[WINDOW], im[WINDOW], wr[WINDOW], wi[WINDOW], window[WINDOW];
+    float mag[WINDOW / 2], prev[WINDOW / 2];
+    struct header h;
+    float *flux, peak, d;
+    size_t frames, i, s;
+    char name[4096];
+    double hop;
+    FILE *f;
+    int k;
+
+    twiddles(wr, wi, WINDOW);
+
+    for (k = 0; k < WINDOW; ++k)
+        window[k] = .5 - .5 * cos(TAU * k / WINDOW);
+
+    hop = (double)rate / RATE;
+    frames = n / hop;
+
+    if (NULL == (flux = calloc(frames + 1, sizeof(*flux))))
+        errx(EXIT_FAILURE, "malloc flux");
+
+    memset(prev, 0, sizeof(prev));
+
+    for (peak = 0, i = 0; i < frames; ++i)
+    {
+        s = i * hop;
+
+        for (k = 0; k < WINDOW; ++k)
+        {
+            re[k] = s + k >= WINDOW / 2 && s + k - WINDOW / 2 < n ? pcm[s + k - WINDOW / 2] * window[k] : 0;
+            im[k] = 0;
+        }
+
+        fft(re, im, wr, wi, WINDOW);
+
+        for (k = 0; k < WINDOW / 2; ++k)
+        {
+            mag[k] = log1pf(100 * sqrtf(re[k] * re[k] + im[k] * im[k]) / WINDOW);
+
+            if ((d = mag[k] - prev[k]) > 0)
+                flux[i] += d;
+
+            prev[k] = mag[k];
+        }
+
+        peak = MAX(peak, flux[i]);
+    }
+
+    for (i = 0; peak > 0 && i < frames; ++i)
+        flux[i] /= peak;
+
+    sidecar(name, sizeof(name), path);
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAGIC, sizeof(h.magic));
+    stamp(&h, path);
+    h.rate = RATE;
+    h.count = frames;
+
+    if (NULL == (f = fopen(name, "w")))
+        err(EXIT_FAILURE, "%s", name);
+
+    if (1 != fwrite(&h, sizeof(h), 1, f) || frames != fwrite(flux, sizeof(*flux), frames, f))
+        err(EXIT_FAILURE, "%s", name);
+
+    if (fclose(f))
+        err(EXIT_FAILURE, "%s", name);
+
+    free(flux);
+}
+
+static int
+onset(int i)
+{
+    double mean;
+    int j;
+
+    for (j = MAX(i - PEAK, 0); j <= MIN(i + PEAK, count - 1); ++j)
+        if (levels[j] > levels[i])
+            return 0;
+
+    for (mean = 0, j = MAX(i - MEAN, 0); j <= MIN(i + PEAK, count - 1); ++j)
+        mean += levels[j];
+
+    mean /= MIN(i + PEAK, count - 1) - MAX(i - MEAN, 0) + 1;
+
+    return levels[i] >= mean + DELTA;
+}
+
+void
+onset_load(const char *path)
+{
+    struct header h, now;
+    char name[4096];
+    FILE *f;
+    int i;
+
+    sidecar(name, sizeof(name), path);
+
+    if (NULL == (f = fopen(name, "r")))
+        return;
+
+    if (1 != fread(&h, sizeof(h), 1, f) || memcmp(h.magic, MAGIC, sizeof(h.magic)) || h.rate != RATE)
+    {
+        fprintf(stderr, "onsets: %s is not an onset file\n", name);
+        fclose(f);
+        return;
+    }
+
+    memset(&now, 0, sizeof(now));
+    stamp(&now, path);
+
+    if (h.size != now.size || h.mtime != now.mtime)
+    {
+        fprintf(stderr, "onsets: %s is out of date, run euclid --analyze\n", name);
+        fclose(f);
+        return;
+    }
+
+    if (NULL == (levels = malloc(h.count * sizeof(*levels))))
+        errx(EXIT_FAILURE, "malloc onsets");
+
+    if (NULL == (last = malloc(h.count * sizeof(*last))))
+        errx(EXIT_FAILURE, "malloc onsets");
+
+    if (h.count != fread(levels, sizeof(*levels), h.count, f))
+        errx(EXIT_FAILURE, "%s: short read", name);
+
+    fclose(f);
+
+    count = h.count;
+
+    for (i = 0; i < count; ++i)
+    {
+        last[i] = i ? last[i - 1] : -1;
+
+        if (onset(i) && (last[i] < 0 || i - last[i] >= SPACING))
+            last[i] = i;
+    }
+
+    free(levels);
+    levels = NULL;
+}
+
+double
+onset_since(double t)
+{
+    int i;
+
+    i = t * RATE;
+
+    if (i < 0 || i >= count || last[i] < 0)
+        return -1;
+
+    return t - (double)last[i] / RATE;
+}
@@ -0,0 +1,3 @@
+void onset_analyze(const char *path, const float *pcm, size_t n, long rate);
+void onset_load(const char *path);
+double onset_since(double t);
@@ -0,0 +1,173 @@
+#define _DEFAULT_SOURCE
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#include "perf.h"
+
+////////////////////////////////////////////////////////////////////////
+
+#define MAX_SCENES 32
+
+struct scene
+{
+    float start, end;
+    uint64_t samples;
+    uint64_t counts[PERF_COUNTERS];
+};
+
+////////////////////////////////////////////////////////////////////////
+
+static int enabled = 0;
+
+static struct scene scenes[MAX_SCENES];
+
+static __thread int leader = -2;
+static __thread int slots[PERF_COUNTERS];
+
+////////////////////////////////////////////////////////////////////////
+
+#ifdef __linux__
+
+static const struct
+{
+    const char *name;
+    uint64_t config;
+} counters[PERF_COUNTERS] = {
+    { "cycles", PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_COUNT_HW_INSTRUCTIONS },
+    { "cache misses", PERF_COUNT_HW_CACHE_MISSES },
+    { "branch misses", PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+static int
+counter(uint64_t config, int group)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static void
+open_group()
+{
+    int i, n;
+
+    if (-1 == (leader = counter(counters[0].config, -1)))
+    {
+        warn("perf_event_open %s", counters[0].name);
+        return;
+    }
+
+    slots[0] = 0;
+
+    for (i = 1, n = 1; i < PERF_COUNTERS; ++i)
+        slots[i] = counter(counters[i].config, leader) == -1 ? -1 : n++;
+}
+
+static int
+sample(uint64_t counts[PERF_COUNTERS])
+{
+    uint64_t values[1 + PERF_COUNTERS];
+    int i;
+
+    if (leader == -2)
+        open_group();
+
+    if (leader == -1 || read(leader, values, sizeof(values)) < (ssize_t)(2 * sizeof(uint64_t)))
+        return 0;
+
+    for (i = 0; i < PERF_COUNTERS; ++i)
+        counts[i] = slots[i] == -1 ? 0 : values[1 + slots[i]];
+
+    return 1;
+}
+
+#else
+
+static int
+sample(uint64_t counts[PERF_COUNTERS])
+{
+    (void)counts;
+
+    return 0;
+}
+
+#endif
+
+static void
+perf_report()
+{
+    const struct scene *s;
+    double ipc, llc, branch;
+    int i;
+
+    fprintf(stderr, "scene   start     end  samples   Gcycles    IPC  misses/kinst  branch misses/kinst\n");
+
+    for (i = 0; i < MAX_SCENES; ++i)
+    {
+        s = scenes + i;
+
+        if (!s->samples)
+            continue;
+
+        ipc = s->counts[0] ? (double)s->counts[1] / s->counts[0] : 0;
+        llc = s->counts[1] ? 1e3 * s->counts[2] / s->counts[1] : 0;
+        branch = s->counts[1] ? 1e3 * s->counts[3] / s->counts[1] : 0;
+
+        fprintf(stderr, "%5d %7.2f %7.2f %8lu %9.3f %6.2f %13.2f %20.2f\n",
+                i, s->start, s->end, (unsigned long)s->samples,
+                s->counts[0] * 1e-9, ipc, llc, branch);
+    }
+}
+
+void
+perf_open()
+{
+    enabled = 1;
+
+    atexit(perf_report);
+}
+
+void
+perf_begin(struct perf_sample *s)
+{
+    s->ok = enabled && sample(s->counts);
+}
+
+void
+perf_end(const struct perf_sample *s, int scene, float start, float end)
+{
+    uint64_t counts[PERF_COUNTERS];
+    struct scene *p;
+    int i;
+
+    if (!s->ok || scene < 0 || scene >= MAX_SCENES || !sample(counts))
+        return;
+
+    p = scenes + scene;
+    p->start = start;
+    p->end = end;
+
+    __atomic_add_fetch(&p->samples, 1, __ATOMIC_RELAXED);
+
+    for (i = 0; i < PERF_COUNTERS; ++i)
+        __atomic_add_fetch(&p->counts[i], counts[i] - s->counts[i], __ATOMIC_RELAXED);
+}
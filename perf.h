@@ -0,0 +1,11 @@
+#define PERF_COUNTERS 4
+
+struct perf_sample
+{
+    int ok;
+    uint64_t counts[PERF_COUNTERS];
+};
+
+void perf_open();
+void perf_begin(struct perf_sample *s);
+void perf_end(const struct perf_sample *s, int scene, float start, float end);
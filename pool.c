@@ -0,0 +1,96 @@
+#include <err.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+
+#include "pool.h"
+#include "trace.h"
+
+#define UNUSED(x) (void)(x)
+
+static struct task *first = NULL;
+static struct task *last = NULL;
+static int numthreads = 0;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t finished = PTHREAD_COND_INITIALIZER;
+
+static void *
+pool_thread(void *arg)
+{
+    struct task *t;
+
+    UNUSED(arg);
+
+    trace_thread("pool");
+
+    pthread_mutex_lock(&lock);
+
+    for (;;)
+    {
+        while (NULL == (t = first))
+            pthread_cond_wait(&work, &lock);
+
+        if (NULL == (first = t->next))
+            last = NULL;
+
+        pthread_mutex_unlock(&lock);
+        t->run(t->arg);
+        pthread_mutex_lock(&lock);
+
+        t->done = 1;
+        pthread_cond_broadcast(&finished);
+    }
+
+    return NULL;
+}
+
+void
+pool_init(int threads)
+{
+    pthread_t thread;
+    int i;
+
+    for (i = 0; i < threads; ++i)
+        if (pthread_create(&thread, NULL, pool_thread, NULL))
+            err(EXIT_FAILURE, "pthread_create");
+
+    numthreads = threads;
+}
+
+void
+pool_submit(struct task *t)
+{
+    if (!numthreads)
+    {
+        t->run(t->arg);
+        t->done = 1;
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+
+    t->next = NULL;
+    t->done = 0;
+
+    if (last)
+        last->next = t;
+    else
+        first = t;
+    last = t;
+
+    pthread_cond_signal(&work);
+    pthread_mutex_unlock(&lock);
+}
+
+void
+pool_wait(struct task *t)
+{
+    pthread_mutex_lock(&lock);
+
+    while (!t->done)
+        pthread_cond_wait(&finished, &lock);
+
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,12 @@
+struct task
+{
+    void (*run)(void *arg);
+    void *arg;
+
+    struct task *next;
+    int done;
+};
+
+void pool_init(int threads);
+void pool_submit(struct task *t);
+void pool_wait(struct task *t);
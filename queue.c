@@ -0,0 +1,209 @@
+#include <err.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+
+#include "queue.h"
+#include "trace.h"
+
+#define UNUSED(x) (void)(x)
+
+enum
+{
+    SLOT_FREE,
+    SLOT_QUEUED,
+    SLOT_BUSY,
+    SLOT_READY,
+    SLOT_SKIPPED,
+    SLOT_TAKEN,
+};
+
+struct slot
+{
+    int state;
+    int n;
+    float t;
+    void *buf;
+};
+
+static struct slot *slots;
+static int numslots = 0;
+
+static int (*render_func)(float t, int n, void *buf);
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER;
+
+static struct slot *
+next_job()
+{
+    struct slot *s, *job;
+
+    job = NULL;
+
+    for (s = slots; s < slots + numslots; ++s)
+        if (s->state == SLOT_QUEUED && (!job || s->t < job->t))
+            job = s;
+
+    return job;
+}
+
+static void *
+render_thread(void *arg)
+{
+    struct slot *s;
+    float t;
+    int n, ok;
+
+    UNUSED(arg);
+
+    trace_thread("render");
+
+    pthread_mutex_lock(&lock);
+
+    for (;;)
+    {
+        while (NULL == (s = next_job()))
+            pthread_cond_wait(&work, &lock);
+
+        s->state = SLOT_BUSY;
+        t = s->t;
+        n = s->n;
+
+        pthread_mutex_unlock(&lock);
+        ok = render_func(t, n, s->buf);
+        pthread_mutex_lock(&lock);
+
+        s->state = ok ? SLOT_READY : SLOT_SKIPPED;
+    }
+
+    return NULL;
+}
+
+void
+queue_init(int workers, int n, size_t size, void *bufs, int (*render)(float t, int n, void *buf))
+{
+    pthread_t thread;
+    int i;
+
+    if (workers < 1 || n < 1)
+        return;
+
+    render_func = render;
+
+    if (NULL == (slots = calloc(n, sizeof(struct slot))))
+        errx(EXIT_FAILURE, "malloc slots");
+
+    for (i = 0; i < n; ++i)
+        slots[i].buf = (char *)bufs + i * size;
+
+    numslots = n;
+
+    for (i = 0; i < workers; ++i)
+        if (pthread_create(&thread, NULL, render_thread, NULL))
+            errx(EXIT_FAILURE, "pthread_create");
+}
+
+void
+queue_schedule(int n, float t, float period)
+{
+    struct slot *s, *idle;
+    float u;
+    int k, wake;
+
+    if (!numslots)
+        return;
+
+    wake = 0;
+
+    pthread_mutex_lock(&lock);
+
+    for (s = slots; s < slots + numslots; ++s)
+    {
+        if (s->t >= t - period / 2)
+            continue;
+
+        if (s->state == SLOT_QUEUED || s->state == SLOT_READY || s->state == SLOT_SKIPPED)
+            s->state = SLOT_FREE;
+    }
+
+    for (k = 1; k <= numslots; ++k)
+    {
+        u = t + k * period;
+        idle = NULL;
+
+        for (s = slots; s < slots + numslots; ++s)
+        {
+            if (s->state == SLOT_FREE)
+            {
+                if (!idle)
+                    idle = s;
+            }
+            else if (s->t > u - period / 2 && s->t < u + period / 2)
+                break;
+        }
+
+        if (s != slots + numslots)
+            continue;
+
+        if (!idle)
+            break;
+
+        idle->state = SLOT_QUEUED;
+        idle->n = n + k;
+        idle->t = u;
+        wake = 1;
+    }
+
+    if (wake)
+        pthread_cond_broadcast(&work);
+
+    pthread_mutex_unlock(&lock);
+}
+
+void *
+queue_take(float t, float tolerance)
+{
+    struct slot *s, *best;
+
+    if (!numslots)
+        return NULL;
+
+    best = NULL;
+
+    pthread_mutex_lock(&lock);
+
+    for (s = slots; s < slots + numslots; ++s)
+    {
+        if (s->state != SLOT_READY)
+            continue;
+
+        if (s->t < t - tolerance || s->t > t + tolerance)
+            continue;
+
+        if (!best || fabsf(s->t - t) < fabsf(best->t - t))
+            best = s;
+    }
+
+    if (best)
+        best->state = SLOT_TAKEN;
+
+    pthread_mutex_unlock(&lock);
+
+    return best ? best->buf : NULL;
+}
+
+void
+queue_release(void *buf)
+{
+    struct slot *s;
+
+    pthread_mutex_lock(&lock);
+
+    for (s = slots; s < slots + numslots; ++s)
+        if (s->buf == buf)
+            s->state = SLOT_FREE;
+
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,4 @@
+void queue_init(int workers, int slots, size_t size, void *bufs, int (*render)(float t, int n, void *buf));
+void queue_schedule(int n, float t, float period);
+void *queue_take(float t, float tolerance);
+void queue_release(void *buf);
@@ -0,0 +1,116 @@
+#include <math.h>
+#include <stdint.h>
+
+#include "raster.h"
+
+////////////////////////////////////////////////////////////////////////
+
+struct target
+{
+    uint8_t *mask;
+    int w, h;
+    int steep;
+};
+
+static void
+plot(const struct target *d, int x, int y, float c)
+{
+    uint8_t v, *p;
+
+    if (d->steep)
+    {
+        int tmp = x;
+        x = y;
+        y = tmp;
+    }
+
+    if (x < 0 || y < 0 || x >= d->w || y >= d->h)
+        return;
+
+    p = d->mask + y * d->w + x;
+    v = 255 * c + .5;
+
+    if (v > *p)
+        *p = v;
+}
+
+static float
+fpart(float x)
+{
+    return x - floorf(x);
+}
+
+static void
+line(struct target *d, float x0, float y0, float x1, float y1)
+{
+    float dx, dy, gradient, xend, yend, xgap, y;
+    int x, xa, xb;
+
+    d->steep = fabsf(y1 - y0) > fabsf(x1 - x0);
+
+    if (d->steep)
+    {
+        float tmp;
+        tmp = x0; x0 = y0; y0 = tmp;
+        tmp = x1; x1 = y1; y1 = tmp;
+    }
+
+    if (x0 > x1)
+    {
+        float tmp;
+        tmp = x0; x0 = x1; x1 = tmp;
+        tmp = y0; y0 = y1; y1 = tmp;
+    }
+
+    dx = x1 - x0;
+    dy = y1 - y0;
+    gradient = dx == 0 ? 1 : dy / dx;
+
+    xend = floorf(x0 + .5);
+    yend = y0 + gradient * (xend - x0);
+    xgap = 1 - fpart(x0 + .5);
+    xa = xend;
+    plot(d, xa, floorf(yend), (1 - fpart(yend)) * xgap);
+    plot(d, xa, floorf(yend) + 1, fpart(yend) * xgap);
+
+    y = yend + gradient;
+
+    xend = floorf(x1 + .5);
+    yend = y1 + gradient * (xend - x1);
+    xgap = fpart(x1 + .5);
+    xb = xend;
+    plot(d, xb, floorf(yend), (1 - fpart(yend)) * xgap);
+    plot(d, xb, floorf(yend) + 1, fpart(yend) * xgap);
+
+    for (x = xa + 1; x < xb; ++x)
+    {
+        plot(d, x, floorf(y), 1 - fpart(y));
+        plot(d, x, floorf(y) + 1, fpart(y));
+
+        y += gradient;
+    }
+}
+
+void
+raster_loop(uint8_t *mask, int w, int h, const float *vertices, int n)
+{
+    struct target d;
+    float x0, y0, x1, y1;
+    int i, j;
+
+    d.mask = mask;
+    d.w = w;
+    d.h = h;
+
+    for (i = 0; i < n; ++i)
+    {
+        j = (i + 1) % n;
+
+        x0 = (vertices[2 * i + 0] + 1) * w / 2 - .5;
+        y0 = (vertices[2 * i + 1] + 1) * h / 2 - .5;
+        x1 = (vertices[2 * j + 0] + 1) * w / 2 - .5;
+        y1 = (vertices[2 * j + 1] + 1) * h / 2 - .5;
+
+        line(&d, x0, y0, x1, y1);
+    }
+}
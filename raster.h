@@ -0,0 +1 @@
+void raster_loop(uint8_t *mask, int w, int h, const float *vertices, int n);
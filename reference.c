@@ -0,0 +1,172 @@
+#include <math.h>
+#include <stdint.h>
+
+#include "effects.h"
+#include "kernels.h"
+
+////////////////////////////////////////////////////////////////////////
+
+static void
+escape(uint8_t *iter, const float *re, float im, int from, int step, int n, int deep)
+{
+    float a, b, za, zb, zaa, zbb, dx, dy;
+    int i, x;
+
+    b = im;
+
+    for (x = from; x < n; x += step)
+    {
+        a = re[x];
+
+        i = 192;
+
+        if (deep)
+        {
+            dx = a + 0.6506;
+            dy = b + 0.4780;
+
+            if (dx * dx + dy * dy < 0.0000007)
+                goto done;
+
+            dx = a + 0.64915;
+            dy = b + 0.47855;
+
+            if (dx * dx + dy * dy < 0.0000002)
+                goto done;
+        }
+        else
+        {
+            dx = a + 0.25;
+            dy = b + 0.0;
+
+            if (dx * dx + dy * dy < 0.23)
+                goto done;
+
+            dx = a + 1;
+            dy = b + 0;
+
+            if (dx * dx + dy * dy < 0.05)
+                goto done;
+
+            dx = a + 0.623;
+            dy = b + 0.425;
+
+            if (dx * dx + dy * dy < 0.00035)
+                goto done;
+        }
+
+        za = a;
+        zb = b;
+
+        for (i = 0; i < 192; ++i)
+        {
+            zaa = za * za;
+            zbb = zb * zb;
+
+            if (zaa + zbb > 4)
+                break;
+
+            zb = (2 * (za * zb)) + b;
+            za = zaa - zbb + a;
+        }
+
+done:
+        iter[x] = i;
+    }
+}
+
+static void
+warp(uint8_t *row, int y, int from, int step, const struct warp *w)
+{
+    float X, Y, a, r;
+    int sx, sy, x;
+    const uint8_t *p;
+
+    for (x = from; x < bw; x += step)
+    {
+        X = x - bw / 2;
+        Y = y - bh / 2;
+
+        a = w->phase + atan2(X, Y);
+        r = sqrtf(X * X + Y * Y);
+
+        a += w->roto;
+        r *= w->zoom;
+
+        X = r * (float)cos(a) + w->zoom * sh * w->ox;
+        Y = r * (float)sin(a) + w->zoom * sh * w->oy;
+
+        sx = (((int)X + ts / 2) + 16 * ts) % ts;
+        sy = (((int)Y + ts / 2) + 16 * ts) % ts;
+
+        p = w->texture + 3 * (sy * ts + sx);
+
+        if (p[0] == 32)
+        {
+            row[x * 3 + 0] = w->flash;
+            row[x * 3 + 1] = w->flash;
+            row[x * 3 + 2] = w->flash;
+        }
+        else
+        {
+            row[x * 3 + 0] = p[0];
+            row[x * 3 + 1] = p[1];
+            row[x * 3 + 2] = p[2];
+        }
+    }
+}
+
+static void
+fire(uint8_t *row, const uint8_t *above, const uint8_t *above2, int n)
+{
+    int x;
+
+    for (x = 0; x < n; ++x)
+    {
+        double a = 0;
+
+        a += 0.60 * above[x];
+
+        if (x > 0)
+            a += 0.05 * above[x - 1];
+
+        if (x < n - 1)
+            a += 0.05 * above[x + 1];
+
+        if (above2)
+        {
+            a += 0.20 * above2[x];
+
+            if (x > 0)
+                a += 0.05 * above2[x - 1];
+
+            if (x < n - 1)
+                a += 0.05 * above2[x + 1];
+        }
+
+        row[x] = 0.99 * a;
+    }
+}
+
+static void
+bgr(uint8_t *out, const uint8_t *in, int n)
+{
+    int x;
+
+    for (x = 0; x < n; ++x)
+    {
+        out[3 * x + 0] = in[3 * x + 2];
+        out[3 * x + 1] = in[3 * x + 1];
+        out[3 * x + 2] = in[3 * x + 0];
+    }
+}
+
+static int
+supported()
+{
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+const struct kernels reference_kernels = { "reference", supported, escape, warp, fire, bgr };
@@ -0,0 +1,439 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <err.h>
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "cache.h"
+#include "effects.h"
+#include "serve.h"
+#include "tga.h"
+#include "timeline.h"
+
+////////////////////////////////////////////////////////////////////////
+
+#define CHECKPOINT 60
+#define MAX_SNAPSHOTS 32
+#define MAX_FRAMES 256
+
+#define MAX_SIZE 8192
+
+////////////////////////////////////////////////////////////////////////
+
+struct entry
+{
+    float t;
+    int w, h;
+    unsigned long used;
+    uint8_t *pixels;
+};
+
+struct snapshot
+{
+    int step;
+    unsigned long used;
+    uint8_t *state;
+};
+
+static struct entry entries[MAX_FRAMES];
+static struct snapshot snapshots[MAX_SNAPSHOTS];
+
+static unsigned long tick;
+static size_t budget, cached;
+
+static struct frame *f;
+static uint8_t *mask, *image;
+
+////////////////////////////////////////////////////////////////////////
+
+static void
+drop_snapshots()
+{
+    int i;
+
+    for (i = 0; i < MAX_SNAPSHOTS; ++i)
+    {
+        free(snapshots[i].state);
+        snapshots[i].state = NULL;
+    }
+}
+
+static void
+resize(int w, int h)
+{
+    void *p;
+
+    if (f)
+    {
+        timeline_prepare(1e9);
+        arena_unmap();
+        cache_close();
+
+        free(image);
+        free(mask);
+        free(f);
+
+        drop_snapshots();
+    }
+
+    effects_size(w, h);
+
+    cache_open(sw, sh, ts);
+
+    effects_reserve(1);
+    arena_map(getenv("EUCLID_HUGEPAGES") && atoi(getenv("EUCLID_HUGEPAGES")));
+
+    if (posix_memalign(&p, 64, sizeof(struct frame) + bh * bw * 3))
+        errx(EXIT_FAILURE, "posix_memalign frame");
+
+    f = p;
+
+    if (NULL == (mask = malloc(sh * sh)))
+        errx(EXIT_FAILURE, "malloc mask");
+
+    if (NULL == (image = malloc(sh * sw * 3)))
+        errx(EXIT_FAILURE, "malloc image");
+}
+
+////////////////////////////////////////////////////////////////////////
+
+static int
+restore(int n)
+{
+    struct snapshot *best;
+    int i;
+
+    for (best = NULL, i = 0; i < MAX_SNAPSHOTS; ++i)
+        if (snapshots[i].state && snapshots[i].step <= n && (!best || best->step < snapshots[i].step))
+            best = snapshots + i;
+
+    if (!best)
+    {
+        restore_fire(NULL);
+        return 0;
+    }
+
+    best->used = ++tick;
+    restore_fire(best->state);
+
+    return best->step;
+}
+
+static void
+snapshot(int step)
+{
+    struct snapshot *s;
+    int i;
+
+    for (s = snapshots, i = 0; i < MAX_SNAPSHOTS; ++i)
+    {
+        if (snapshots[i].state && snapshots[i].step == step)
+            return;
+
+        if (!snapshots[i].state || (s->state && snapshots[i].used < s->used))
+            s = snapshots + i;
+    }
+
+    if (!s->state && NULL == (s->state = malloc(save_fire(NULL))))
+        errx(EXIT_FAILURE, "malloc snapshot");
+
+    save_fire(s->state);
+    s->step = step;
+    s->used = ++tick;
+}
+
+static void
+simulate(float t)
+{
+    int from, n;
+
+    if (0 > (n = timeline_steps(t)))
+        return;
+
+    for (from = restore(n); from < n; from += CHECKPOINT)
+    {
+        timeline_advance(t, from, from + CHECKPOINT < n ? from + CHECKPOINT : n);
+
+        if (from + CHECKPOINT <= n)
+            snapshot(from + CHECKPOINT);
+    }
+}
+
+static int
+render(float t, uint8_t *out)
+{
+    float ink, paper;
+    const uint8_t *p;
+    int m, x, y;
+    uint8_t v;
+
+    timeline_prepare(t);
+    timeline_wait(t);
+
+    simulate(t);
+
+    f->parity = -1;
+
+    if (timeline_render(t, f, 1))
+    {
+        for (y = 0; y < sh; ++y)
+        {
+            p = f->pixels + (y * bh / sh) * bw * 3;
+
+            for (x = 0; x < sw; ++x)
+                memcpy(out + (y * sw + x) * 3, p + (x * bw / sw) * 3, 3);
+        }
+
+        return 1;
+    }
+
+    if (!timeline_paper(t, &paper, &ink))
+        return 0;
+
+    memset(mask, 0, sh * sh);
+    timeline_trace(t, mask, sh);
+
+    for (y = 0; y < sh; ++y)
+    {
+        for (x = 0; x < sw; ++x)
+        {
+            m = x - (sw - sh) / 2;
+            m = m >= 0 && m < sh ? mask[y * sh + m] : 0;
+
+            v = 255 * (paper + (ink - paper) * m / 255) + .5;
+
+            out[(y * sw + x) * 3 + 0] = v;
+            out[(y * sw + x) * 3 + 1] = v;
+            out[(y * sw + x) * 3 + 2] = v;
+        }
+    }
+
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+static struct entry *
+lookup(float t, int w, int h)
+{
+    int i;
+
+    for (i = 0; i < MAX_FRAMES; ++i)
+    {
+        if (entries[i].pixels && entries[i].t == t && entries[i].w == w && entries[i].h == h)
+        {
+            entries[i].used = ++tick;
+            return entries + i;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+evict(struct entry *e)
+{
+    cached -= (size_t)e->w * e->h * 3;
+
+    free(e->pixels);
+    e->pixels = NULL;
+}
+
+static struct entry *
+slot(size_t size)
+{
+    struct entry *e;
+    int i;
+
+    for (;;)
+    {
+        for (e = NULL, i = 0; i < MAX_FRAMES; ++i)
+        {
+            if (!entries[i].pixels && cached + size <= budget)
+                return entries + i;
+
+            if (entries[i].pixels && (!e || entries[i].used < e->used))
+                e = entries + i;
+        }
+
+        evict(e);
+    }
+}
+
+static struct entry *
+frame(float t, int w, int h)
+{
+    static struct entry scratch;
+    struct entry *e;
+    size_t size;
+
+    if ((e = lookup(t, w, h)))
+        return e;
+
+    if (w != sw || h != sh)
+        resize(w, h);
+
+    if (!render(t, image))
+        return NULL;
+
+    size = (size_t)w * h * 3;
+
+    if (size > budget)
+    {
+        e = &scratch;
+        e->pixels = image;
+    }
+    else
+    {
+        e = slot(size);
+
+        if (NULL == (e->pixels = malloc(size)))
+            errx(EXIT_FAILURE, "malloc cached frame");
+
+        memcpy(e->pixels, image, size);
+        cached += size;
+    }
+
+    e->t = t;
+    e->w = w;
+    e->h = h;
+    e->used = ++tick;
+
+    return e;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+static int
+respond(FILE *out, const struct entry *e, int tga)
+{
+    size_t n;
+    char *buf;
+    FILE *mem;
+
+    if (!tga)
+    {
+        n = (size_t)e->w * e->h * 3;
+
+        return 0 > fprintf(out, "ok %d %d %zu\n", e->w, e->h, n) ||
+               1 != fwrite(e->pixels, n, 1, out);
+    }
+
+    if (NULL == (mem = open_memstream(&buf, &n)))
+        err(EXIT_FAILURE, "open_memstream");
+
+    tga_write(mem, e->pixels, e->w, e->h);
+    fclose(mem);
+
+    if (0 > fprintf(out, "ok %d %d %zu\n", e->w, e->h, n) || 1 != fwrite(buf, n, 1, out))
+        n = 0;
+
+    free(buf);
+
+    return !n;
+}
+
+static void
+session(int fd)
+{
+    char line[128], kind[8];
+    FILE *in, *out;
+    struct entry *e;
+    float from, t, to;
+    int c, w, h;
+
+    if (NULL == (in = fdopen(fd, "r")))
+        err(EXIT_FAILURE, "fdopen");
+
+    if (NULL == (out = fdopen(dup(fd), "w")))
+        err(EXIT_FAILURE, "fdopen");
+
+    while (fgets(line, sizeof(line), in))
+    {
+        strcpy(kind, "raw");
+
+        if (!strchr(line, '\n') && !feof(in))
+        {
+            fprintf(out, "error line too long\n");
+
+            while ((c = getc(in)) != EOF && c != '\n')
+                ;
+        }
+        else if (3 > sscanf(line, "%f %dx%d %7s", &t, &w, &h, kind) ||
+            w < quality || h < quality || w > MAX_SIZE || h > MAX_SIZE)
+        {
+            fprintf(out, "error bad request\n");
+        }
+        else if (strcmp(kind, "raw") && strcmp(kind, "tga"))
+        {
+            fprintf(out, "error unknown format %s\n", kind);
+        }
+        else if (!isfinite(t) || timeline_scene(t, &from, &to) < 0 || t < from ||
+                 !(e = frame(t, w, h)))
+        {
+            fprintf(out, "error nothing at %g\n", t);
+        }
+        else if (respond(out, e, !strcmp(kind, "tga")))
+        {
+            break;
+        }
+
+        if (fflush(out))
+            break;
+    }
+
+    fclose(out);
+    fclose(in);
+}
+
+void
+serve(const char *path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd, client;
+
+    budget = (getenv("EUCLID_SERVE_CACHE") ? atof(getenv("EUCLID_SERVE_CACHE")) : 256) * (1 << 20);
+
+    signal(SIGPIPE, SIG_IGN);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        errx(EXIT_FAILURE, "%s: path too long", path);
+
+    strcpy(addr.sun_path, path);
+
+    if (0 == stat(path, &st) && S_ISSOCK(st.st_mode))
+        unlink(path);
+
+    if (-1 == (fd = socket(AF_UNIX, SOCK_STREAM, 0)))
+        err(EXIT_FAILURE, "socket");
+
+    if (-1 == bind(fd, (struct sockaddr *)&addr, sizeof(addr)))
+        err(EXIT_FAILURE, "%s", path);
+
+    if (-1 == listen(fd, 8))
+        err(EXIT_FAILURE, "listen");
+
+    for (;;)
+    {
+        if (-1 == (client = accept(fd, NULL, NULL)))
+        {
+            warn("accept");
+            continue;
+        }
+
+        session(client);
+    }
+}
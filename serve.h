@@ -0,0 +1 @@
+void serve(const char *path);
@@ -0,0 +1,166 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "stats.h"
+
+////////////////////////////////////////////////////////////////////////
+
+#define MAX_SCENES 32
+
+struct scene
+{
+    float start, end;
+    double *intervals;
+    int count, size;
+    int missed;
+};
+
+////////////////////////////////////////////////////////////////////////
+
+static struct scene scenes[MAX_SCENES + 1];
+
+static const char *output = NULL;
+static double period = 1.0 / 60;
+static double last = -1;
+static double average = 0;
+static int missed = 0;
+
+////////////////////////////////////////////////////////////////////////
+
+static void
+add(struct scene *s, double interval)
+{
+    if (s->count == s->size)
+    {
+        s->size = s->size ? 2 * s->size : 1024;
+
+        if (NULL == (s->intervals = realloc(s->intervals, s->size * sizeof(double))))
+            errx(EXIT_FAILURE, "malloc stats");
+    }
+
+    s->intervals[s->count++] = interval;
+
+    if (interval > 1.5 * period)
+        ++s->missed;
+}
+
+static int
+compare(const void *a, const void *b)
+{
+    double x, y;
+
+    x = *(const double *)a;
+    y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void
+line(FILE *f, const char *name, struct scene *s)
+{
+    const double *v;
+    int n;
+
+    v = s->intervals;
+    n = s->count;
+
+    qsort(s->intervals, n, sizeof(double), compare);
+
+    fprintf(f, "%-5s %7.2f %7.2f %7d %8.2f %8.2f %8.2f %8.2f %7d\n",
+            name, s->start, s->end, n,
+            v[(n - 1) * 50 / 100] * 1e3, v[(n - 1) * 95 / 100] * 1e3,
+            v[(n - 1) * 99 / 100] * 1e3, v[n - 1] * 1e3, s->missed);
+}
+
+static void
+stats_report()
+{
+    struct scene *all;
+    struct rusage usage;
+    char name[8];
+    FILE *f;
+    int i, j;
+
+    if (!strcmp(output, "-"))
+        f = stderr;
+    else if (NULL == (f = fopen(output, "w")))
+        err(EXIT_FAILURE, "%s", output);
+
+    all = scenes + MAX_SCENES;
+
+    fprintf(f, "scene   start     end  frames   p50 ms   p95 ms   p99 ms   max ms  missed\n");
+
+    for (i = 0; i < MAX_SCENES; ++i)
+    {
+        if (!scenes[i].count)
+            continue;
+
+        if (!all->count)
+            all->start = scenes[i].start;
+
+        all->end = scenes[i].end;
+
+        for (j = 0; j < scenes[i].count; ++j)
+            add(all, scenes[i].intervals[j]);
+
+        sprintf(name, "%d", i);
+        line(f, name, scenes + i);
+    }
+
+    if (all->count)
+        line(f, "all", all);
+
+    if (!getrusage(RUSAGE_SELF, &usage))
+        fprintf(f, "refresh %.2f Hz, peak rss %ld kB\n", 1 / period, usage.ru_maxrss);
+
+    if (f != stderr)
+        fclose(f);
+}
+
+void
+stats_open(const char *path, double refresh)
+{
+    output = path;
+
+    if (refresh > 0)
+        period = 1 / refresh;
+
+    atexit(stats_report);
+}
+
+void
+stats_frame(int scene, float start, float end, double now)
+{
+    double interval;
+
+    interval = now - last;
+
+    if (last >= 0 && interval > 0)
+    {
+        average = average ? .95 * average + .05 * interval : interval;
+
+        if (interval > 1.5 * period)
+            ++missed;
+
+        if (output && scene >= 0 && scene < MAX_SCENES)
+        {
+            scenes[scene].start = start;
+            scenes[scene].end = end;
+            add(scenes + scene, interval);
+        }
+    }
+
+    last = now;
+}
+
+void
+stats_summary(char *buf, size_t n)
+{
+    snprintf(buf, n, "%5.1f fps %6.2f ms %5d missed",
+             average ? 1 / average : 0, average * 1e3, missed);
+}
@@ -0,0 +1,3 @@
+void stats_open(const char *path, double refresh);
+void stats_frame(int scene, float start, float end, double now);
+void stats_summary(char *buf, size_t n);
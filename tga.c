@@ -0,0 +1,42 @@
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernels.h"
+#include "tga.h"
+
+////////////////////////////////////////////////////////////////////////
+
+void
+tga_write(FILE *file, uint8_t *pixels, const uint16_t width, const uint16_t height)
+{
+    struct tga_header h;
+    uint8_t *row;
+    int y;
+
+    memset(&h, 0, sizeof(struct tga_header));
+    h.image_type = 2;
+    h.y_origin = 0;
+    h.image_width = width;
+    h.image_height = height;
+    h.pixel_depth = 24;
+    h.image_descriptor = 0;
+
+    if(1 != fwrite(&h, sizeof(struct tga_header), 1, file))
+        err(EXIT_FAILURE, "fwrite header");
+
+    if (NULL == (row = malloc(width * 3)))
+        errx(EXIT_FAILURE, "malloc row");
+
+    for(y = 0; y < height; ++y)
+    {
+        kernels->bgr(row, pixels + y * width * 3, width);
+
+        if(1 != fwrite(row, width * 3, 1, file))
+            err(EXIT_FAILURE, "fwrite pixels");
+    }
+
+    free(row);
+}
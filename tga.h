@@ -17,3 +17,5 @@ struct tga_header {
 };
 
 #pragma pack(pop)
+
+void tga_write(FILE *file, uint8_t *pixels, const uint16_t width, const uint16_t height);
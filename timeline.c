@@ -0,0 +1,643 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <GL/gl.h>
+
+#include "effects.h"
+#include "pool.h"
+#include "timeline.h"
+#include "trace.h"
+
+////////////////////////////////////////////////////////////////////////
+
+#define UNUSED(x) (void)(x)
+
+#define LENGTH(a) (sizeof(a) / sizeof((a)[0]))
+
+#define LOOKAHEAD 2
+#define LINGER 1
+
+////////////////////////////////////////////////////////////////////////
+
+enum
+{
+    EFFECT_UNLOADED,
+    EFFECT_PENDING,
+    EFFECT_LOADING,
+    EFFECT_READY,
+    EFFECT_RELEASING,
+};
+
+struct scene;
+
+struct effect
+{
+    void (*init)();
+    void (*release)();
+    void (*step)(const struct scene *s, float t);
+    struct effect *needs;
+    int serial;
+
+    float first, last;
+    int state;
+    int users;
+    struct task task;
+};
+
+struct scene
+{
+    float start, end;
+    struct effect *effect;
+    void (*render)(const struct scene *s, float t, struct frame *f);
+    void (*draw)(const struct scene *s, float t);
+    void (*trace)(const struct scene *s, float t, uint8_t *mask, int size);
+    float arg;
+};
+
+////////////////////////////////////////////////////////////////////////
+
+static void
+mandelbrot_intro(const struct scene *s, float t, struct frame *f)
+{
+    UNUSED(s);
+
+    draw_mandelbrot(f, 0, 0, 2, -.5 * t, 0);
+}
+
+static void
+mandelbrot_zoom(const struct scene *s, float t, struct frame *f)
+{
+    float u, x, y, z;
+
+    UNUSED(s);
+
+    u = (t - 0) / (16.5 - 0);
+
+    z = pow(2, lerp(1, -12, u));
+    x = lerp(.0, -0.6506, 1 - z / 2);
+    y = lerp(.0, -0.4785, 1 - z / 2);
+
+    draw_mandelbrot(f, x, y, z, 0, u);
+}
+
+static float
+koch_time(float t)
+{
+    return (t - 16.5) / (30 - 16.5);
+}
+
+static void
+koch_morph(const struct scene *s, float t)
+{
+    UNUSED(s);
+
+    glClearColor(0.0, 0.0, 0.0, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    draw_koch(koch_time(t));
+}
+
+static void
+koch_trace(const struct scene *s, float t, uint8_t *mask, int size)
+{
+    UNUSED(s);
+
+    mask_koch(mask, size, koch_time(t));
+}
+
+static void
+kochz_warp(const struct scene *s, float t, struct frame *f)
+{
+    UNUSED(s);
+
+    draw_kochz(f, (t - 30) / (45 - 30), t + 2);
+}
+
+static void
+qochz_warp(const struct scene *s, float t, struct frame *f)
+{
+    float u;
+
+    UNUSED(s);
+
+    u = (t - 57.73) / (66.25 - 57.73);
+
+    draw_qochz(f, 1 - u / 2);
+}
+
+static void
+qochz_hold(const struct scene *s, float t, struct frame *f)
+{
+    UNUSED(t);
+
+    draw_qochz(f, s->arg);
+}
+
+static float
+qoch_time(float t)
+{
+    return 1 - (t - 65) / (77 - 65);
+}
+
+static void
+qoch_morph(const struct scene *s, float t)
+{
+    UNUSED(s);
+
+    glClearColor(1.0, 1.0, 1.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    draw_qoch(qoch_time(t));
+}
+
+static void
+qoch_trace(const struct scene *s, float t, uint8_t *mask, int size)
+{
+    UNUSED(s);
+
+    mask_qoch(mask, size, qoch_time(t));
+}
+
+static float
+fade_time(float t)
+{
+    return (t - 77) / (80 - 77);
+}
+
+static void
+qoch_fade(const struct scene *s, float t)
+{
+    float u;
+
+    UNUSED(s);
+
+    u = fade_time(t);
+
+    glClearColor(1 - u, 1 - u, 1 - u, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    draw_qoch(0);
+}
+
+static void
+qoch_still(const struct scene *s, float t, uint8_t *mask, int size)
+{
+    UNUSED(s);
+    UNUSED(t);
+
+    mask_qoch(mask, size, 0);
+}
+
+static void
+black(const struct scene *s, float t)
+{
+    UNUSED(s);
+    UNUSED(t);
+
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+}
+
+static void
+fire_render(const struct scene *s, float t, struct frame *f)
+{
+    UNUSED(t);
+
+    draw_fire(f, s->arg);
+}
+
+static void
+fire_step(const struct scene *s, float t)
+{
+    UNUSED(t);
+
+    draw_fire(NULL, s->arg);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+static struct effect mandelbrot = { make_mandelbrot, NULL, NULL, NULL, 0, 0, 0, EFFECT_UNLOADED, 0, { 0 } };
+static struct effect koch = { make_koch, free_koch, NULL, NULL, 0, 0, 0, EFFECT_UNLOADED, 0, { 0 } };
+static struct effect kochz = { make_kochz, free_kochz, NULL, &koch, 0, 0, 0, EFFECT_UNLOADED, 0, { 0 } };
+static struct effect qoch = { make_qoch, free_qoch, NULL, NULL, 0, 0, 0, EFFECT_UNLOADED, 0, { 0 } };
+static struct effect qochz = { make_qochz, free_qochz, NULL, &qoch, 0, 0, 0, EFFECT_UNLOADED, 0, { 0 } };
+static struct effect fire = { make_fire, free_fire, fire_step, NULL, 1, 0, 0, EFFECT_UNLOADED, 0, { 0 } };
+
+static struct effect *effects[] = {
+    &mandelbrot, &koch, &kochz, &qoch, &qochz, &fire,
+};
+
+static const struct scene scenes[] = {
+    { -2,    0,     &mandelbrot, mandelbrot_intro, NULL,       NULL,       0  },
+    {  0,    16.5,  &mandelbrot, mandelbrot_zoom,  NULL,       NULL,       0  },
+    { 16.5,  30,    &koch,       NULL,             koch_morph, koch_trace, 0  },
+    { 30,    57.73, &kochz,      kochz_warp,       NULL,       NULL,       0  },
+    { 57.73, 66.06, &qochz,      qochz_warp,       NULL,       NULL,       0  },
+    { 66.06, 66.28, &qochz,      qochz_hold,       NULL,       NULL,       .3 },
+    { 66.28, 66.8,  &qochz,      qochz_hold,       NULL,       NULL,       0  },
+    { 66.8,  77,    &qoch,       NULL,             qoch_morph, qoch_trace, 0  },
+    { 77,    80,    &qoch,       NULL,             qoch_fade,  qoch_still, 0  },
+    { 80,    81.22, NULL,        NULL,             black,      NULL,       0  },
+    { 81.22, 84.14, &fire,       fire_render,      NULL,       NULL,       0  },
+    { 84.14, 87.88, &fire,       fire_render,      NULL,       NULL,       .2 },
+    { 87.88, 93,    &fire,       fire_render,      NULL,       NULL,       1  },
+};
+
+////////////////////////////////////////////////////////////////////////
+
+static const struct scene *
+lookup(float t)
+{
+    int lo, hi, mid;
+
+    lo = 0;
+    hi = LENGTH(scenes) - 1;
+
+    if (t >= scenes[hi].end)
+        return NULL;
+
+    while (lo < hi)
+    {
+        mid = (lo + hi + 1) / 2;
+
+        if (scenes[mid].start <= t)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    return scenes + lo;
+}
+
+static void
+span()
+{
+    static int done = 0;
+    const struct scene *s;
+    size_t i;
+
+    if (done)
+        return;
+
+    for (i = 0; i < LENGTH(effects); ++i)
+    {
+        effects[i]->first = INFINITY;
+        effects[i]->last = -INFINITY;
+    }
+
+    for (s = scenes; s < scenes + LENGTH(scenes); ++s)
+    {
+        if (!s->effect)
+            continue;
+
+        s->effect->first = fmin(s->effect->first, s->start);
+        s->effect->last = fmax(s->effect->last, s->end);
+    }
+
+    done = 1;
+}
+
+static int
+acquire(struct effect *e)
+{
+    if (!e)
+        return 1;
+
+    __atomic_add_fetch(&e->users, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&e->state, __ATOMIC_SEQ_CST) == EFFECT_READY)
+        return 1;
+
+    __atomic_sub_fetch(&e->users, 1, __ATOMIC_SEQ_CST);
+
+    return 0;
+}
+
+static void
+drop(struct effect *e)
+{
+    if (e)
+        __atomic_sub_fetch(&e->users, 1, __ATOMIC_SEQ_CST);
+}
+
+static int
+transition(struct effect *e, int from, int to)
+{
+    return __atomic_compare_exchange_n(&e->state, &from, to, 0,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static void load_task(void *arg);
+
+static void
+start(struct effect *e)
+{
+    if (e->needs && __atomic_load_n(&e->needs->state, __ATOMIC_SEQ_CST) != EFFECT_READY)
+        return;
+
+    if (!transition(e, EFFECT_PENDING, EFFECT_LOADING))
+        return;
+
+    e->task.run = load_task;
+    e->task.arg = e;
+
+    pool_submit(&e->task);
+}
+
+static void
+load_task(void *arg)
+{
+    struct effect *e;
+    double begin;
+    size_t i;
+
+    e = arg;
+
+    begin = trace_begin();
+
+    if (e->init)
+        e->init();
+
+    trace_end("load", begin);
+
+    __atomic_store_n(&e->state, EFFECT_READY, __ATOMIC_SEQ_CST);
+
+    for (i = 0; i < LENGTH(effects); ++i)
+        if (effects[i]->needs == e)
+            start(effects[i]);
+}
+
+static void
+load(struct effect *e)
+{
+    if (__atomic_load_n(&e->state, __ATOMIC_SEQ_CST) != EFFECT_UNLOADED)
+        return;
+
+    if (e->needs)
+        load(e->needs);
+
+    if (transition(e, EFFECT_UNLOADED, EFFECT_PENDING))
+        start(e);
+}
+
+static int
+needed(struct effect *e)
+{
+    size_t i;
+    int state;
+
+    for (i = 0; i < LENGTH(effects); ++i)
+    {
+        if (effects[i]->needs != e)
+            continue;
+
+        state = __atomic_load_n(&effects[i]->state, __ATOMIC_SEQ_CST);
+
+        if (state == EFFECT_PENDING || state == EFFECT_LOADING)
+            return 1;
+    }
+
+    return 0;
+}
+
+static void
+await(struct effect *e)
+{
+    struct timespec ts;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = 100000;
+
+    while (__atomic_load_n(&e->state, __ATOMIC_SEQ_CST) != EFFECT_READY)
+        nanosleep(&ts, NULL);
+}
+
+static void
+unload(struct effect *e)
+{
+    struct timespec ts;
+
+    if (transition(e, EFFECT_PENDING, EFFECT_UNLOADED))
+        return;
+
+    if (needed(e) || !transition(e, EFFECT_READY, EFFECT_RELEASING))
+        return;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = 100000;
+
+    while (__atomic_load_n(&e->users, __ATOMIC_SEQ_CST))
+        nanosleep(&ts, NULL);
+
+    if (e->release)
+        e->release();
+
+    __atomic_store_n(&e->state, EFFECT_UNLOADED, __ATOMIC_SEQ_CST);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+void
+timeline_prepare(float t)
+{
+    struct effect *e;
+    size_t i;
+
+    span();
+
+    for (i = 0; i < LENGTH(effects); ++i)
+    {
+        e = effects[i];
+
+        if (t >= e->first - LOOKAHEAD && t < e->last + LINGER)
+            load(e);
+        else
+            unload(e);
+    }
+}
+
+static int
+advance(struct effect *e, float t, int from, int to)
+{
+    const struct scene *s;
+    float u;
+    int n;
+
+    for (n = 0, u = e->first; u < t && (to < 0 || n < to); u += 1.0 / 60, ++n)
+        if (n >= from && (s = lookup(u)) && s->effect == e)
+            e->step(s, u);
+
+    return n;
+}
+
+static struct effect *
+simulation(float t)
+{
+    const struct scene *s;
+
+    span();
+
+    if (!(s = lookup(t)) || !s->effect || !s->effect->step || t <= s->effect->first)
+        return NULL;
+
+    return s->effect;
+}
+
+void
+timeline_warm_up(float t)
+{
+    struct effect *e;
+    size_t i;
+
+    span();
+
+    for (i = 0; i < LENGTH(effects); ++i)
+    {
+        e = effects[i];
+
+        if (!e->step || t <= e->first || t >= e->last)
+            continue;
+
+        load(e);
+        await(e);
+
+        advance(e, t, 0, -1);
+    }
+}
+
+int
+timeline_steps(float t)
+{
+    struct effect *e;
+
+    if (!(e = simulation(t)))
+        return -1;
+
+    return advance(e, t, INT_MAX, -1);
+}
+
+void
+timeline_advance(float t, int from, int to)
+{
+    struct effect *e;
+
+    if (!(e = simulation(t)))
+        return;
+
+    load(e);
+    await(e);
+
+    advance(e, t, from, to);
+}
+
+void
+timeline_wait(float t)
+{
+    const struct scene *s;
+
+    if (!(s = lookup(t)) || !s->effect)
+        return;
+
+    load(s->effect);
+    await(s->effect);
+}
+
+int
+timeline_render(float t, struct frame *f, int serial)
+{
+    const struct scene *s;
+
+    if (!(s = lookup(t)) || !s->render)
+        return 0;
+
+    if (s->effect->serial && !serial)
+        return 0;
+
+    if (!acquire(s->effect))
+        return 0;
+
+    s->render(s, t, f);
+
+    drop(s->effect);
+
+    return 1;
+}
+
+int
+timeline_draw(float t)
+{
+    const struct scene *s;
+
+    if (!(s = lookup(t)) || !s->draw)
+        return 0;
+
+    if (!acquire(s->effect))
+        return 0;
+
+    s->draw(s, t);
+
+    drop(s->effect);
+
+    return 1;
+}
+
+int
+timeline_trace(float t, uint8_t *mask, int size)
+{
+    const struct scene *s;
+
+    if (!(s = lookup(t)) || !s->trace)
+        return 0;
+
+    if (!acquire(s->effect))
+        return 0;
+
+    s->trace(s, t, mask, size);
+
+    drop(s->effect);
+
+    return 1;
+}
+
+int
+timeline_paper(float t, float *paper, float *ink)
+{
+    const struct scene *s;
+
+    if (!(s = lookup(t)))
+        return 0;
+
+    if (s->draw == qoch_morph)
+        *paper = 1, *ink = 0;
+    else if (s->draw == qoch_fade)
+        *paper = 1 - fade_time(t), *ink = 0;
+    else
+        *paper = 0, *ink = 1;
+
+    return 1;
+}
+
+int
+timeline_scene(float t, float *start, float *end)
+{
+    const struct scene *s;
+
+    if (!(s = lookup(t)))
+        return -1;
+
+    *start = s->start;
+    *end = s->end;
+
+    return s - scenes;
+}
+
+int
+timeline_done(float t)
+{
+    return !lookup(t);
+}
@@ -0,0 +1,11 @@
+void timeline_prepare(float t);
+void timeline_warm_up(float t);
+int timeline_steps(float t);
+void timeline_advance(float t, int from, int to);
+void timeline_wait(float t);
+int timeline_render(float t, struct frame *f, int serial);
+int timeline_draw(float t);
+int timeline_trace(float t, uint8_t *mask, int size);
+int timeline_paper(float t, float *paper, float *ink);
+int timeline_scene(float t, float *start, float *end);
+int timeline_done(float t);
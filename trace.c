@@ -0,0 +1,150 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "trace.h"
+
+////////////////////////////////////////////////////////////////////////
+
+#define MAX_EVENTS (1 << 18)
+
+struct event
+{
+    const char *name;
+    double begin, duration;
+    int thread;
+    char phase;
+};
+
+////////////////////////////////////////////////////////////////////////
+
+static struct event *events = NULL;
+static unsigned numevents = 0;
+static unsigned numthreads = 0;
+
+static FILE *file;
+static double origin;
+
+static __thread int thread = 0;
+
+////////////////////////////////////////////////////////////////////////
+
+static double
+now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int
+self()
+{
+    if (!thread)
+        thread = __atomic_add_fetch(&numthreads, 1, __ATOMIC_RELAXED);
+
+    return thread;
+}
+
+static void
+record(const char *name, char phase, double begin, double duration)
+{
+    struct event *e;
+    unsigned i;
+
+    if ((i = __atomic_fetch_add(&numevents, 1, __ATOMIC_RELAXED)) >= MAX_EVENTS)
+        return;
+
+    e = events + i;
+    e->begin = begin - origin;
+    e->duration = duration;
+    e->thread = self();
+    e->phase = phase;
+
+    __atomic_store_n(&e->name, name, __ATOMIC_RELEASE);
+}
+
+static void
+trace_write()
+{
+    const struct event *e;
+    const char *name;
+    unsigned i, n;
+
+    n = __atomic_load_n(&numevents, __ATOMIC_RELAXED);
+
+    if (n > MAX_EVENTS)
+    {
+        fprintf(stderr, "trace: dropped %u events\n", n - MAX_EVENTS);
+        n = MAX_EVENTS;
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+
+    for (i = 0; i < n; ++i)
+    {
+        e = events + i;
+
+        if (NULL == (name = __atomic_load_n(&e->name, __ATOMIC_ACQUIRE)))
+            continue;
+
+        if (e->phase == 'M')
+            fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+                    e->thread, name);
+        else if (e->phase == 'i')
+            fprintf(file, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%.3f},\n",
+                    name, e->thread, e->begin * 1e6);
+        else
+            fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f},\n",
+                    name, e->thread, e->begin * 1e6, e->duration * 1e6);
+    }
+
+    fprintf(file, "{}]}\n");
+    fclose(file);
+}
+
+void
+trace_open(const char *path)
+{
+    if (NULL == (file = fopen(path, "w")))
+        err(EXIT_FAILURE, "%s", path);
+
+    if (NULL == (events = calloc(MAX_EVENTS, sizeof(struct event))))
+        errx(EXIT_FAILURE, "malloc trace");
+
+    origin = now();
+
+    atexit(trace_write);
+}
+
+void
+trace_thread(const char *name)
+{
+    if (events)
+        record(name, 'M', origin, 0);
+}
+
+double
+trace_begin()
+{
+    return events ? now() : 0;
+}
+
+void
+trace_end(const char *name, double begin)
+{
+    if (events)
+        record(name, 'X', begin, now() - begin);
+}
+
+void
+trace_instant(const char *name)
+{
+    if (events)
+        record(name, 'i', now(), 0);
+}
@@ -0,0 +1,5 @@
+void trace_open(const char *path);
+void trace_thread(const char *name);
+double trace_begin();
+void trace_end(const char *name, double begin);
+void trace_instant(const char *name);